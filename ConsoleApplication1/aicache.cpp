@@ -0,0 +1,318 @@
+﻿#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "aicache.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+// 文件布局：64 字节文件头 + slotCount 个槽位
+// 文件头：magic(4) slotCount(4) slotSize(4)
+// 槽位：key(8) expires(8) lastUsed(8) length(4) 保留(4) + 回复内容；key 为 0 表示空槽位
+static const uint32_t cacheMagic = 0x31434941;  // "AIC1"
+static const size_t fileHeaderSize = 64;
+static const size_t slotHeaderSize = 32;
+
+AICache::AICache()
+{
+}
+AICache::~AICache()
+{
+    close();
+}
+
+bool AICache::open(const std::string& file, int capacity, int slotSize)
+{
+    close();
+    clear();
+    this->capacity = capacity > 0 ? capacity : 1;
+    if (slotSize <= (int)slotHeaderSize) return false;
+
+    size_t size = fileHeaderSize + (size_t)this->capacity * slotSize;
+#ifdef _WIN32
+    HANDLE f = CreateFileA(file.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER oldSize;
+    GetFileSizeEx(f, &oldSize);
+    HANDLE m = CreateFileMappingA(f, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+    if (!m) {
+        CloseHandle(f);
+        return false;
+    }
+    void* p = MapViewOfFile(m, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!p) {
+        CloseHandle(m);
+        CloseHandle(f);
+        return false;
+    }
+    fileHandle = (intptr_t)f;
+    mapHandle = (intptr_t)m;
+    size_t existing = (size_t)oldSize.QuadPart;
+#else
+    int f = ::open(file.c_str(), O_RDWR | O_CREAT, 0644);
+    if (f < 0) return false;
+    struct stat st;
+    fstat(f, &st);
+    size_t existing = (size_t)st.st_size;
+    if (existing < size && ftruncate(f, (off_t)size) != 0) {
+        ::close(f);
+        return false;
+    }
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+    if (p == MAP_FAILED) {
+        ::close(f);
+        return false;
+    }
+    fileHandle = f;
+#endif
+    view = (uint8_t*)p;
+    viewSize = size;
+    slotCount = this->capacity;
+    this->slotSize = slotSize;
+
+    // 文件头不匹配（新文件或参数变化）时清空重建
+    uint32_t head[3];
+    memcpy(head, view, sizeof(head));
+    if (existing < size || head[0] != cacheMagic || head[1] != (uint32_t)slotCount || head[2] != (uint32_t)slotSize) {
+        memset(view, 0, size);
+        head[0] = cacheMagic;
+        head[1] = (uint32_t)slotCount;
+        head[2] = (uint32_t)slotSize;
+        memcpy(view, head, sizeof(head));
+    }
+    load();
+    return true;
+}
+
+void AICache::close()
+{
+    if (!view) return;
+#ifdef _WIN32
+    FlushViewOfFile(view, viewSize);
+    UnmapViewOfFile(view);
+    CloseHandle((HANDLE)mapHandle);
+    CloseHandle((HANDLE)fileHandle);
+#else
+    msync(view, viewSize, MS_ASYNC);
+    munmap(view, viewSize);
+    ::close((int)fileHandle);
+#endif
+    view = nullptr;
+    viewSize = 0;
+    fileHandle = mapHandle = -1;
+
+    // 关闭后继续作为纯内存缓存使用
+    for (auto& e : lru) e.slot = -1;
+    freeSlots.clear();
+    slotCount = 0;
+}
+
+bool AICache::isOpen() const
+{
+    return view != nullptr;
+}
+
+uint8_t* AICache::slotPtr(int slot)
+{
+    return view + fileHeaderSize + (size_t)slot * slotSize;
+}
+
+// 从文件恢复未过期的条目，按 lastUsed 重建 LRU 顺序
+void AICache::load()
+{
+    struct Loaded { long long used; int slot; };
+    std::vector<Loaded> found;
+    long long now = (long long)time(nullptr);
+    for (int i = slotCount - 1; i >= 0; i--) {
+        uint8_t* p = slotPtr(i);
+        uint64_t key;
+        long long expires, used;
+        memcpy(&key, p, 8);
+        memcpy(&expires, p + 8, 8);
+        memcpy(&used, p + 16, 8);
+        if (key == 0) {
+            freeSlots.push_back(i);
+            continue;
+        }
+        if (expires <= now || index.count(key)) {
+            clearSlot(i);
+            freeSlots.push_back(i);
+            continue;
+        }
+        found.push_back({ used, i });
+        if (used > useCounter) useCounter = used;
+    }
+
+    std::sort(found.begin(), found.end(), [](const Loaded& a, const Loaded& b) { return a.used > b.used; });
+    for (auto& f : found) {
+        uint8_t* p = slotPtr(f.slot);
+        Entry e;
+        uint32_t length;
+        memcpy(&e.key, p, 8);
+        memcpy(&e.expires, p + 8, 8);
+        memcpy(&length, p + 24, 4);
+        if (length > slotSize - slotHeaderSize) length = (uint32_t)(slotSize - slotHeaderSize);
+        e.reply.assign((const char*)p + slotHeaderSize, length);
+        e.slot = f.slot;
+        lru.push_back(e);
+        index[e.key] = std::prev(lru.end());
+    }
+    stats.entries = (int)lru.size();
+}
+
+void AICache::writeSlot(const Entry& e)
+{
+    uint8_t* p = slotPtr(e.slot);
+    uint32_t length = (uint32_t)e.reply.size();
+    long long used = ++useCounter;
+    // 先清 key，内容写完后再写 key，中途退出时不会留下半条记录
+    memset(p, 0, 8);
+    memcpy(p + 8, &e.expires, 8);
+    memcpy(p + 16, &used, 8);
+    memcpy(p + 24, &length, 4);
+    memcpy(p + slotHeaderSize, e.reply.data(), length);
+    memcpy(p, &e.key, 8);
+}
+
+void AICache::touchSlot(int slot)
+{
+    long long used = ++useCounter;
+    memcpy(slotPtr(slot) + 16, &used, 8);
+}
+
+void AICache::clearSlot(int slot)
+{
+    memset(slotPtr(slot), 0, 8);
+}
+
+void AICache::remove(std::list<Entry>::iterator it)
+{
+    if (it->slot >= 0 && view) {
+        clearSlot(it->slot);
+        freeSlots.push_back(it->slot);
+    }
+    index.erase(it->key);
+    lru.erase(it);
+    stats.entries = (int)lru.size();
+}
+
+bool AICache::get(uint64_t key, std::string& reply)
+{
+    auto found = index.find(key);
+    if (found == index.end()) {
+        stats.misses++;
+        return false;
+    }
+    auto it = found->second;
+    if (it->expires <= (long long)time(nullptr)) {
+        remove(it);
+        stats.expired++;
+        stats.misses++;
+        return false;
+    }
+
+    lru.splice(lru.begin(), lru, it);
+    if (it->slot >= 0 && view) touchSlot(it->slot);
+    reply = it->reply;
+    stats.hits++;
+    return true;
+}
+
+void AICache::put(uint64_t key, const std::string& reply, int ttlSec)
+{
+    auto found = index.find(key);
+    if (found != index.end())
+        remove(found->second);
+    while ((int)lru.size() >= capacity) {
+        remove(std::prev(lru.end()));
+        stats.evictions++;
+    }
+
+    Entry e;
+    e.key = key;
+    e.reply = reply;
+    e.expires = (long long)time(nullptr) + ttlSec;
+    e.slot = -1;
+    if (view && !freeSlots.empty() && reply.size() <= (size_t)slotSize - slotHeaderSize) {
+        e.slot = freeSlots.back();
+        freeSlots.pop_back();
+        writeSlot(e);
+    }
+    lru.push_front(e);
+    index[key] = lru.begin();
+    stats.stores++;
+    stats.entries = (int)lru.size();
+}
+
+void AICache::clear()
+{
+    while (!lru.empty())
+        remove(lru.begin());
+}
+
+const AICacheStats& AICache::getStats() const
+{
+    return stats;
+}
+
+uint64_t AICache::hash(const std::string& data, uint64_t seed)
+{
+    uint64_t h = seed;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    // 混入长度作为分隔，避免 ("ab","c") 与 ("a","bc") 得到相同的键
+    h ^= data.size();
+    h *= 1099511628211ULL;
+    return h ? h : 1;   // 0 保留给空槽位
+}
+
+std::string AICache::normalize(const std::string& utf8)
+{
+    std::string out;
+    out.reserve(utf8.size());
+    bool space = false;
+    for (size_t i = 0; i < utf8.size(); i++) {
+        unsigned char c = utf8[i];
+        // ASCII 空白与全角空格（E3 80 80）都视为一个空格
+        bool isSpace = c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        if (!isSpace && c == 0xE3 && i + 2 < utf8.size()
+            && (unsigned char)utf8[i + 1] == 0x80 && (unsigned char)utf8[i + 2] == 0x80) {
+            isSpace = true;
+            i += 2;
+        }
+        if (isSpace) {
+            space = !out.empty();
+            continue;
+        }
+        if (space) out += ' ';
+        space = false;
+        out += (c >= 'A' && c <= 'Z') ? (char)(c + 32) : (char)c;
+    }
+
+    // 去掉句末标点：? . ! 以及全角 ？（EF BC 9F）！（EF BC 81）。（E3 80 82）
+    while (!out.empty()) {
+        char c = out.back();
+        if (c == '?' || c == '.' || c == '!') {
+            out.pop_back();
+            continue;
+        }
+        if (out.size() >= 3) {
+            std::string tail = out.substr(out.size() - 3);
+            if (tail == "\xEF\xBC\x9F" || tail == "\xEF\xBC\x81" || tail == "\xE3\x80\x82") {
+                out.resize(out.size() - 3);
+                continue;
+            }
+        }
+        break;
+    }
+    while (!out.empty() && out.back() == ' ') out.pop_back();
+    return out;
+}
@@ -0,0 +1,79 @@
+﻿#pragma once
+#include <string>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// 缓存统计
+struct AICacheStats
+{
+    long long hits = 0;       // 命中次数
+    long long misses = 0;     // 未命中次数（含过期）
+    long long expired = 0;    // 因过期而失效的次数
+    long long stores = 0;     // 写入次数
+    long long evictions = 0;  // 因容量淘汰的条目数
+    int entries = 0;          // 当前条目数
+
+    double hitRatio() const {
+        long long n = hits + misses;
+        return n > 0 ? (double)hits / n : 0;
+    }
+};
+
+// AICache：AI 回复的 LRU 缓存
+// 内存中用链表 + 哈希表维护 LRU 顺序，条目同时写入内存映射文件中的固定大小槽位，
+// 程序重启后从文件恢复未过期的条目。超过槽位大小的回复只保存在内存中
+class AICache
+{
+public:
+    AICache();
+    ~AICache();
+
+    // 打开（不存在则创建）缓存文件，capacity 为条目数，slotSize 为每个槽位字节数
+    // 文件打开失败时仍可作为纯内存缓存使用
+    bool open(const std::string& file, int capacity, int slotSize = 4096);
+    void close();
+    bool isOpen() const;
+
+    // 查找未过期的回复，命中时移到最近使用位置
+    bool get(uint64_t key, std::string& reply);
+    // 写入回复，ttlSec 秒后过期
+    void put(uint64_t key, const std::string& reply, int ttlSec);
+    void clear();
+
+    const AICacheStats& getStats() const;
+
+    // FNV-1a 64 位哈希，seed 用于把多个字段串联成一个键
+    static uint64_t hash(const std::string& data, uint64_t seed = 14695981039346656037ULL);
+    // 规范化用户输入：去掉首尾空白和句末标点，合并连续空白，ASCII 转小写
+    static std::string normalize(const std::string& utf8);
+private:
+    struct Entry {
+        uint64_t key;
+        std::string reply;
+        long long expires;  // 过期时间（Unix 秒）
+        int slot;           // 文件槽位，-1 表示只在内存中
+    };
+    std::list<Entry> lru;   // 头部为最近使用
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    std::vector<int> freeSlots;
+    int capacity = 256;
+    AICacheStats stats;
+
+    // 内存映射文件
+    uint8_t* view = nullptr;
+    size_t viewSize = 0;
+    int slotCount = 0;
+    int slotSize = 0;
+    long long useCounter = 0;   // 写入槽位的使用序号，用于重启后恢复 LRU 顺序
+    intptr_t fileHandle = -1;
+    intptr_t mapHandle = -1;
+
+    uint8_t* slotPtr(int slot);
+    void writeSlot(const Entry& e);
+    void touchSlot(int slot);
+    void clearSlot(int slot);
+    void remove(std::list<Entry>::iterator it);
+    void load();
+};
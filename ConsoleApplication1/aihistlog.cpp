@@ -0,0 +1,316 @@
+﻿#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+#include "aihistlog.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// 文件布局：64 字节文件头 + 记录
+// 文件头：magic(4) version(4) dataEnd(8) records(8)
+// 记录：length(4) + 内容 + length(4)，length 为内容字节数
+// 内容：kind(4) tokens(4) contentLen(4) toolCallsLen(4) + content + toolCalls + toolCallId
+static const uint32_t logMagic = 0x314C4941;   // "AIL1"
+static const uint32_t logVersion = 1;
+static const long long fileHeaderSize = 64;
+static const uint32_t payloadFixed = 16;
+
+// kind：0 为会话边界
+static uint8_t roleKind(const std::string& role)
+{
+    if (role == "user") return 1;
+    if (role == "assistant") return 2;
+    if (role == "tool") return 3;
+    return 2;
+}
+static const char* kindRole(uint8_t kind)
+{
+    switch (kind) {
+    case 1: return "user";
+    case 3: return "tool";
+    default: return "assistant";
+    }
+}
+
+// -------- 文件操作 --------
+static intptr_t fileOpen(const std::string& path, bool truncate)
+{
+#ifdef _WIN32
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    return f == INVALID_HANDLE_VALUE ? -1 : (intptr_t)f;
+#else
+    int f = ::open(path.c_str(), O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+    return f < 0 ? -1 : f;
+#endif
+}
+static void fileClose(intptr_t f)
+{
+#ifdef _WIN32
+    CloseHandle((HANDLE)f);
+#else
+    ::close((int)f);
+#endif
+}
+static long long fileSize(intptr_t f)
+{
+#ifdef _WIN32
+    LARGE_INTEGER size;
+    return GetFileSizeEx((HANDLE)f, &size) ? size.QuadPart : 0;
+#else
+    struct stat st;
+    return fstat((int)f, &st) == 0 ? (long long)st.st_size : 0;
+#endif
+}
+static bool fileWrite(intptr_t f, long long offset, const void* data, size_t len)
+{
+#ifdef _WIN32
+    OVERLAPPED ov = {};
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)((unsigned long long)offset >> 32);
+    DWORD written = 0;
+    return WriteFile((HANDLE)f, data, (DWORD)len, &written, &ov) && written == len;
+#else
+    return pwrite((int)f, data, len, (off_t)offset) == (ssize_t)len;
+#endif
+}
+static bool fileRead(intptr_t f, long long offset, void* data, size_t len)
+{
+#ifdef _WIN32
+    OVERLAPPED ov = {};
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)((unsigned long long)offset >> 32);
+    DWORD got = 0;
+    return ReadFile((HANDLE)f, data, (DWORD)len, &got, &ov) && got == len;
+#else
+    return pread((int)f, data, len, (off_t)offset) == (ssize_t)len;
+#endif
+}
+static bool fileReplace(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// 编码一条记录并追加到 out
+static void encodeRecord(std::string& out, uint8_t kind, const AILogRecord& r)
+{
+    uint32_t length = payloadFixed + (uint32_t)(r.content.size() + r.toolCalls.size() + r.toolCallId.size());
+    uint32_t fixed[4] = { kind, (uint32_t)r.tokens, (uint32_t)r.content.size(), (uint32_t)r.toolCalls.size() };
+    out.append((const char*)&length, 4);
+    out.append((const char*)fixed, sizeof(fixed));
+    out += r.content;
+    out += r.toolCalls;
+    out += r.toolCallId;
+    out.append((const char*)&length, 4);
+}
+static std::string encodeHeader(long long dataEnd, long long records)
+{
+    std::string head(fileHeaderSize, '\0');
+    memcpy(&head[0], &logMagic, 4);
+    memcpy(&head[4], &logVersion, 4);
+    memcpy(&head[8], &dataEnd, 8);
+    memcpy(&head[16], &records, 8);
+    return head;
+}
+
+AIHistoryLog::AIHistoryLog()
+{
+}
+AIHistoryLog::~AIHistoryLog()
+{
+    close();
+}
+
+bool AIHistoryLog::open(const std::string& file, int keepTokens, long long compactBytes)
+{
+    close();
+    stats = AILogStats();
+    this->keepTokens = keepTokens;
+    this->compactBytes = compactBytes;
+    path = file;
+    fileHandle = fileOpen(file, false);
+    if (fileHandle < 0) return false;
+
+    // 文件头不匹配（新文件或格式不同）时重建
+    char head[fileHeaderSize];
+    uint32_t magic = 0, version = 0;
+    long long end = 0, records = 0;
+    long long size = fileSize(fileHandle);
+    if (size >= fileHeaderSize && fileRead(fileHandle, 0, head, sizeof(head))) {
+        memcpy(&magic, head, 4);
+        memcpy(&version, head + 4, 4);
+        memcpy(&end, head + 8, 8);
+        memcpy(&records, head + 16, 8);
+    }
+    if (magic != logMagic || version != logVersion || end < fileHeaderSize || end > size) {
+        end = fileHeaderSize;
+        records = 0;
+        std::string h = encodeHeader(end, records);
+        if (!fileWrite(fileHandle, 0, h.data(), h.size())) {
+            close();
+            return false;
+        }
+    }
+    dataEnd = end;
+    stats.records = records;
+    stats.fileBytes = end;
+    return true;
+}
+
+void AIHistoryLog::close()
+{
+    if (fileHandle < 0) return;
+    fileClose(fileHandle);
+    fileHandle = -1;
+}
+
+bool AIHistoryLog::isOpen() const
+{
+    return fileHandle >= 0;
+}
+
+bool AIHistoryLog::commitEnd()
+{
+    long long fields[2] = { dataEnd, stats.records };
+    stats.fileBytes = dataEnd;
+    return fileWrite(fileHandle, 8, fields, sizeof(fields));
+}
+
+bool AIHistoryLog::writeRecord(uint8_t kind, const AILogRecord& record)
+{
+    if (fileHandle < 0) return false;
+    std::string buf;
+    encodeRecord(buf, kind, record);
+    // 先写记录再更新文件头，文件头之外的残留数据在下次写入时被覆盖
+    if (!fileWrite(fileHandle, dataEnd, buf.data(), buf.size()))
+        return false;
+    dataEnd += (long long)buf.size();
+    stats.records++;
+    if (!commitEnd()) return false;
+    if (dataEnd > compactBytes)
+        compact();
+    return true;
+}
+
+bool AIHistoryLog::append(const AILogRecord& record)
+{
+    return writeRecord(roleKind(record.role), record);
+}
+
+bool AIHistoryLog::appendBoundary()
+{
+    return writeRecord(0, AILogRecord());
+}
+
+std::vector<AILogRecord> AIHistoryLog::tail(int tokenLimit)
+{
+    std::vector<AILogRecord> out;
+    if (fileHandle < 0 || dataEnd <= fileHeaderSize) return out;
+    auto t0 = std::chrono::steady_clock::now();
+
+    // 映射到内存，只有尾部被访问的页会被读入
+    size_t size = (size_t)dataEnd;
+#ifdef _WIN32
+    HANDLE m = CreateFileMappingA((HANDLE)fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m) return out;
+    const uint8_t* view = (const uint8_t*)MapViewOfFile(m, FILE_MAP_READ, 0, 0, size);
+    if (!view) {
+        CloseHandle(m);
+        return out;
+    }
+#else
+    void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, (int)fileHandle, 0);
+    if (p == MAP_FAILED) return out;
+    const uint8_t* view = (const uint8_t*)p;
+#endif
+
+    long long pos = dataEnd;
+    int sum = 0;
+    while (pos - fileHeaderSize >= (long long)payloadFixed + 8) {
+        uint32_t length, lead;
+        memcpy(&length, view + pos - 4, 4);
+        if (length < payloadFixed || (long long)length + 8 > pos - fileHeaderSize) break;
+        const uint8_t* payload = view + pos - 4 - length;
+        memcpy(&lead, payload - 4, 4);
+        if (lead != length) break;   // 长度前后不一致：文件损坏，停止恢复
+
+        uint32_t fixed[4];
+        memcpy(fixed, payload, sizeof(fixed));
+        if (fixed[0] == 0) break;    // 会话边界
+        int tokens = (int)fixed[1];
+        if (!out.empty() && sum + tokens > tokenLimit) break;
+        if ((unsigned long long)fixed[2] + fixed[3] > length - payloadFixed) break;
+
+        const char* text = (const char*)payload + payloadFixed;
+        AILogRecord r;
+        r.role = kindRole((uint8_t)fixed[0]);
+        r.tokens = tokens;
+        r.content.assign(text, fixed[2]);
+        r.toolCalls.assign(text + fixed[2], fixed[3]);
+        r.toolCallId.assign(text + fixed[2] + fixed[3], length - payloadFixed - fixed[2] - fixed[3]);
+        out.push_back(r);
+        sum += tokens;
+        pos -= (long long)length + 8;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+    CloseHandle(m);
+#else
+    munmap(p, size);
+#endif
+    std::reverse(out.begin(), out.end());
+    stats.resumed = (int)out.size();
+    stats.resumeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return out;
+}
+
+bool AIHistoryLog::compact()
+{
+    if (fileHandle < 0) return false;
+    int resumed = stats.resumed;
+    double resumeMs = stats.resumeMs;
+    std::vector<AILogRecord> keep = tail(keepTokens);
+    stats.resumed = resumed;
+    stats.resumeMs = resumeMs;
+
+    // 写入临时文件后替换原文件，中途失败时原文件保持不变
+    std::string buf;
+    for (auto& r : keep)
+        encodeRecord(buf, roleKind(r.role), r);
+    long long end = fileHeaderSize + (long long)buf.size();
+    buf.insert(0, encodeHeader(end, (long long)keep.size()));
+
+    std::string tmp = path + ".tmp";
+    intptr_t f = fileOpen(tmp, true);
+    if (f < 0) return false;
+    bool ok = fileWrite(f, 0, buf.data(), buf.size());
+    fileClose(f);
+    if (!ok) return false;
+
+    fileClose(fileHandle);
+    ok = fileReplace(tmp, path);
+    fileHandle = fileOpen(path, false);
+    if (!ok || fileHandle < 0)
+        return false;   // 替换失败时重新打开的仍是原文件，dataEnd 不变
+    dataEnd = end;
+    stats.records = (long long)keep.size();
+    stats.fileBytes = end;
+    stats.compactions++;
+    return true;
+}
+
+const AILogStats& AIHistoryLog::getStats() const
+{
+    return stats;
+}
@@ -0,0 +1,60 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// 日志中的一条消息
+struct AILogRecord
+{
+    std::string role;        // "user"、"assistant" 或 "tool"
+    std::string content;
+    std::string toolCalls;   // 已编码的 tool_calls JSON 数组
+    std::string toolCallId;
+    int tokens = 0;          // 写入时估算的 token 数，恢复时不再重新计算
+};
+
+// 日志统计
+struct AILogStats
+{
+    long long records = 0;      // 文件中的记录数（含会话边界）
+    long long fileBytes = 0;    // 有效数据字节数
+    int compactions = 0;        // 压缩次数
+    int resumed = 0;            // 上次恢复的消息数
+    double resumeMs = 0;        // 上次恢复耗时（毫秒）
+};
+
+// AIHistoryLog：对话历史的只追加日志
+// 每条记录前后各有一个长度字段，可以从文件尾部向前逐条跳读：
+// 恢复时把文件映射到内存，只访问最后 N 个 token 对应的记录，耗时与日志总长度无关
+// 文件头保存有效数据的末尾位置，记录写完后才更新，中途退出留下的半条记录会被忽略
+// 有效数据超过 compactBytes 时，只保留最近 keepTokens 个 token 的记录重写文件
+class AIHistoryLog
+{
+public:
+    AIHistoryLog();
+    ~AIHistoryLog();
+
+    bool open(const std::string& file, int keepTokens = 16000, long long compactBytes = 4 << 20);
+    void close();
+    bool isOpen() const;
+
+    bool append(const AILogRecord& record);
+    // 写入会话边界（清空历史），恢复时不会越过边界
+    bool appendBoundary();
+    // 从尾部向前读取，直到累计 token 超过 tokenLimit 或遇到会话边界；结果按时间顺序排列
+    std::vector<AILogRecord> tail(int tokenLimit);
+    // 只保留最近 keepTokens 个 token 的记录重写文件
+    bool compact();
+
+    const AILogStats& getStats() const;
+private:
+    std::string path;
+    intptr_t fileHandle = -1;
+    long long dataEnd = 0;      // 有效数据末尾（文件偏移）
+    int keepTokens = 16000;
+    long long compactBytes = 4 << 20;
+    AILogStats stats;
+
+    bool writeRecord(uint8_t kind, const AILogRecord& record);
+    bool commitEnd();
+};
@@ -0,0 +1,90 @@
+﻿#include "aimetrics.h"
+#include <algorithm>
+
+double AIRequestTiming::tokensPerSec() const
+{
+    // 一次性到达的流式应答（生成时间不足 1 ms）不计速度
+    double genMs = streamed ? totalMs - firstTokenMs : totalMs;
+    return genMs >= 1 && completionTokens > 0 && (!streamed || firstTokenMs > 0) ? completionTokens * 1000.0 / genMs : 0;
+}
+
+RollingPercentiles::RollingPercentiles(int capacity) : samples(capacity > 0 ? capacity : 1)
+{
+}
+
+void RollingPercentiles::add(double v)
+{
+    samples[next] = v;
+    next = (next + 1) % (int)samples.size();
+    if (filled < (int)samples.size()) filled++;
+}
+
+void RollingPercentiles::clear()
+{
+    next = filled = 0;
+}
+
+double RollingPercentiles::percentile(double p) const
+{
+    if (filled == 0) return 0;
+    // 只在打印时调用，复制后用 nth_element 取最近秩
+    std::vector<double> sorted(samples.begin(), samples.begin() + filled);
+    size_t rank = (size_t)(p / 100.0 * (filled - 1) + 0.5);
+    if (rank >= sorted.size()) rank = sorted.size() - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+AILatencyStats::AILatencyStats(int window) : metrics(MetricCount, RollingPercentiles(window))
+{
+}
+
+void AILatencyStats::record(const AIRequestTiming& t)
+{
+    total++;
+    retried += t.attempts - 1 - (t.hedged ? 1 : 0);
+    if (t.hedged) hedged++;
+    if (t.hedgeWon) hedgeWon++;
+    metrics[Queue].add(t.queueMs);
+    if (!t.ok) {
+        // 失败的请求只计数与排队时间，不影响延迟分布
+        failed++;
+        return;
+    }
+    // 重试过或对冲请求胜出时各阶段混有多次请求，不计入阶段分布
+    bool single = t.attempts - (t.hedged ? 1 : 0) == 1 && !t.hedgeWon;
+    if (single) {
+        double handshake = std::max(t.connectMs, t.tlsMs);
+        metrics[DNS].add(t.dnsMs);
+        metrics[TCP].add(t.connectMs > t.dnsMs ? t.connectMs - t.dnsMs : 0);
+        metrics[TLS].add(t.tlsMs > t.connectMs ? t.tlsMs - t.connectMs : 0);
+        metrics[Wait].add(t.firstByteMs > handshake ? t.firstByteMs - handshake : 0);
+        metrics[FirstByte].add(t.firstByteMs);
+    }
+    if (t.firstTokenMs > 0) {
+        if (single) metrics[FirstToken].add(t.firstTokenMs);
+        metrics[Generate].add(t.totalMs > t.firstTokenMs ? t.totalMs - t.firstTokenMs : 0);
+    }
+    metrics[Total].add(t.totalMs);
+    metrics[Parse].add(t.parseMs);
+    metrics[Print].add(t.printMs);
+    if (t.tokensPerSec() > 0)
+        metrics[TokensPerSec].add(t.tokensPerSec());
+    metrics[PromptTokens].add((double)t.promptTokens);
+    metrics[CompletionTokens].add((double)t.completionTokens);
+}
+
+void AILatencyStats::clear()
+{
+    for (auto& m : metrics) m.clear();
+    total = failed = retried = hedged = hedgeWon = 0;
+}
+
+const char* AILatencyStats::name(Metric m)
+{
+    static const char* const names[MetricCount] = {
+        "queue", "dns", "tcp", "tls", "wait", "ttfb", "ttft", "generate", "total", "parse", "print",
+        "tok/s", "prompt", "completion",
+    };
+    return names[m];
+}
@@ -0,0 +1,78 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+
+// 一次 AI 请求的耗时分解（毫秒）与 token 数
+// dns / connect / tls / firstByte 为 curl 从开始执行算起的累计时间（namelookup / connect / appconnect / starttransfer），
+// 复用连接时前三项为 0
+struct AIRequestTiming
+{
+    bool ok = false;
+    bool streamed = false;      // 流式应答；非流式时没有首 token 时间，生成速度按总耗时计算
+    double queueMs = 0;         // 提交到事件循环开始执行
+    double dnsMs = 0;
+    double connectMs = 0;
+    double tlsMs = 0;           // 明文 HTTP 为 0
+    double firstByteMs = 0;
+    double firstTokenMs = 0;    // 第一段文本或工具调用到达，没有时为 0
+    double totalMs = 0;
+    double parseMs = 0;         // 本地解析应答
+    double printMs = 0;         // 流式输出回调（显示、提前执行等）
+    long long promptTokens = 0;
+    long long completionTokens = 0;
+    int attempts = 1;           // 实际发出的请求数（含重试与对冲）
+    bool hedged = false;        // 发出过对冲请求
+    bool hedgeWon = false;      // 结果来自对冲请求
+    double retryWaitMs = 0;     // 重试前的累计等待
+
+    // 生成速度：流式为首个 token 之后的输出 token / 秒，非流式为整个请求的平均值；无法计算时为 0
+    double tokensPerSec() const;
+};
+
+// RollingPercentiles：保留最近 capacity 个样本的滚动窗口，按需排序求百分位
+class RollingPercentiles
+{
+public:
+    explicit RollingPercentiles(int capacity = 256);
+    void add(double v);
+    void clear();
+    int count() const { return filled; }
+    // p 为 0~100；没有样本时返回 0
+    double percentile(double p) const;
+private:
+    std::vector<double> samples;
+    int next = 0;
+    int filled = 0;
+};
+
+// AILatencyStats：每项指标一个滚动窗口
+// 阶段耗时按差值记录：DNS、TCP（connect - dns）、TLS（appconnect - connect）、
+// 等待（首字节 - 握手完成，含服务端排队与首 token 之前的处理）、生成（总耗时 - 首 token）
+// 重试过或对冲请求胜出时各阶段混有多次请求，只计入总耗时等端到端指标，首字节 / 首 token 分布可用作对冲阈值
+class AILatencyStats
+{
+public:
+    enum Metric {
+        Queue, DNS, TCP, TLS, Wait, FirstByte, FirstToken, Generate, Total, Parse, Print,
+        TokensPerSec, PromptTokens, CompletionTokens, MetricCount
+    };
+
+    explicit AILatencyStats(int window = 256);
+    void record(const AIRequestTiming& t);
+    void clear();
+    long long requests() const { return total; }
+    long long failures() const { return failed; }
+    long long retries() const { return retried; }
+    long long hedges() const { return hedged; }
+    long long hedgeWins() const { return hedgeWon; }
+    int count(Metric m) const { return metrics[m].count(); }
+    double percentile(Metric m, double p) const { return metrics[m].percentile(p); }
+    static const char* name(Metric m);
+private:
+    std::vector<RollingPercentiles> metrics;
+    long long total = 0;
+    long long failed = 0;
+    long long retried = 0;
+    long long hedged = 0;
+    long long hedgeWon = 0;
+};
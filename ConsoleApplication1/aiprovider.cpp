@@ -0,0 +1,87 @@
+﻿#include "aiprovider.h"
+#include <fstream>
+#include <cstdlib>
+
+static std::string trim(const std::string& s)
+{
+    size_t b = 0, e = s.size();
+    while (b < e && (s[b] == ' ' || s[b] == '\t')) b++;
+    while (e > b && (s[e - 1] == ' ' || s[e - 1] == '\t' || s[e - 1] == '\r')) e--;
+    return s.substr(b, e - b);
+}
+
+static bool isTrue(const std::string& v)
+{
+    return v == "1" || v == "true" || v == "yes" || v == "on";
+}
+
+int AIProviderConfig::load(const std::string& file)
+{
+    std::ifstream in(file);
+    if (!in) return -1;
+    providers.clear();
+    defaultName.clear();
+    controlName.clear();
+
+    std::string line;
+    bool first = true;
+    AIProvider* cur = nullptr;
+    while (std::getline(in, line)) {
+        if (first && line.rfind("\xEF\xBB\xBF", 0) == 0) line = line.substr(3);
+        first = false;
+        line = trim(line);
+        if (line.empty() || line[0] == '#') continue;
+        if (line[0] == '[' && line.back() == ']') {
+            // 新接口：除名称外都从默认值开始，本地服务默认不需要 Key
+            providers.push_back(AIProvider());
+            cur = &providers.back();
+            cur->name = trim(line.substr(1, line.size() - 2));
+            cur->needsKey = false;
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        std::string key = trim(line.substr(0, eq)), value = trim(line.substr(eq + 1));
+        if (!cur) {
+            if (key == "default") defaultName = value;
+            else if (key == "control") controlName = value;
+            continue;
+        }
+        if (key == "endpoint") cur->endpoint = value;
+        else if (key == "model") cur->model = value;
+        else if (key == "key") {
+            cur->apiKey = value;
+            cur->needsKey = !value.empty();
+        }
+        else if (key == "stream") cur->streaming = isTrue(value);
+        else if (key == "tools") cur->tools = isTrue(value);
+        else if (key == "local") cur->local = isTrue(value);
+        else if (key == "timeout_ms") cur->timeoutMs = atoi(value.c_str());
+        else if (key == "connect_timeout_ms") cur->connectTimeoutMs = atoi(value.c_str());
+    }
+    return (int)providers.size();
+}
+
+const AIProvider* AIProviderConfig::find(const std::string& name) const
+{
+    for (auto& p : providers)
+        if (p.name == name) return &p;
+    return nullptr;
+}
+
+const AIProvider* AIProviderConfig::defaultProvider() const
+{
+    if (!defaultName.empty()) return find(defaultName);
+    // 没有指定时优先云端接口
+    for (auto& p : providers)
+        if (!p.local) return &p;
+    return providers.empty() ? nullptr : &providers[0];
+}
+
+const AIProvider* AIProviderConfig::controlProvider() const
+{
+    if (!controlName.empty()) return find(controlName);
+    for (auto& p : providers)
+        if (p.local) return &p;
+    return nullptr;
+}
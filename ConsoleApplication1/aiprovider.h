@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+
+// 一个 OpenAI 兼容的 chat/completions 接口
+struct AIProvider
+{
+    std::string name = "deepseek";
+    std::string endpoint = "https://api.deepseek.com/v1/chat/completions";
+    std::string model = "deepseek-chat";
+    std::string apiKey;             // 为空时不发送 Authorization 头
+    bool needsKey = true;           // 没有 API Key 时不能使用（局域网内的推理服务通常不需要）
+    bool streaming = true;          // 支持 stream=true（SSE），否则按非流式请求
+    bool tools = true;              // 支持 tools 函数调用，否则请求中不带工具定义，由模型按文本格式回答
+    bool local = false;             // 本机或局域网服务
+    int timeoutMs = 0;              // 请求超时上限，0 表示使用调用者给出的超时
+    int connectTimeoutMs = 0;       // 建立连接的超时，0 表示使用 curl 默认值
+
+    bool usable() const { return !endpoint.empty() && (!needsKey || !apiKey.empty()); }
+};
+
+// AIProviderConfig：从配置文件加载接口列表
+// 文件为 UTF-8 文本，# 开头为注释；"[名称]" 开始一个接口，之后的 键=值 属于该接口：
+//   endpoint / model / key / stream / tools / local / timeout_ms / connect_timeout_ms
+// 第一个 "[名称]" 之前的 default=名称 与 control=名称 选择对话使用的接口与 AI 控制优先使用的接口；
+// 没有写 control 时取第一个 local=1 的接口
+class AIProviderConfig
+{
+public:
+    // 返回加载的接口数，文件打不开返回 -1
+    int load(const std::string& file);
+    const std::vector<AIProvider>& all() const { return providers; }
+    const AIProvider* find(const std::string& name) const;
+    // 对话、批量提问与摘要使用的接口，没有配置时为 nullptr
+    const AIProvider* defaultProvider() const;
+    // 延迟敏感的 AI 控制请求优先使用的接口，没有配置时为 nullptr
+    const AIProvider* controlProvider() const;
+private:
+    std::vector<AIProvider> providers;
+    std::string defaultName;
+    std::string controlName;
+};
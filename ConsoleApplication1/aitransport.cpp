@@ -0,0 +1,401 @@
+﻿#include "aitransport.h"
+#include <curl/curl.h>
+#include <random>
+
+// ---------- AITransfer ----------
+void AITransfer::cancel()
+{
+    cancelRequested = true;
+    if (owner) owner->wakeup();
+}
+bool AITransfer::wait(int timeoutMs)
+{
+    std::unique_lock<std::mutex> lk(m);
+    if (timeoutMs < 0) {
+        cv.wait(lk, [this] { return done.load(); });
+        return true;
+    }
+    return cv.wait_for(lk, std::chrono::milliseconds(timeoutMs), [this] { return done.load(); });
+}
+double AITransfer::elapsedMs() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// ---------- AIAttempt ----------
+// 429 与 5xx 可以重试
+static bool retryableStatus(long status)
+{
+    return status == 429 || status >= 500;
+}
+size_t AIAttempt::write(const char* data, size_t n)
+{
+    if (transfer->isCancelRequested() || abandoned) return 0;   // 返回 0 使 curl 中止传输
+    if (held) {
+        heldBody.append(data, n);
+        return n;
+    }
+    if (!transfer->winner) {
+        // 第一块应答数据：可重试的状态先保留内容；否则这个请求胜出，对冲的另一方放弃
+        long status = 0;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+        if (retryableStatus(status)) {
+            held = true;
+            heldBody.append(data, n);
+            return n;
+        }
+        transfer->winner = this;
+        for (AIAttempt* other : transfer->live)
+            if (other != this) other->abandoned = true;
+    }
+    else if (transfer->winner != this)
+        return 0;
+    if (transfer->onData) transfer->onData(data, n);
+    return n;
+}
+int AIAttempt::progress(long long dlnow)
+{
+    if (transfer->onProgress && dlnow > 0 && transfer->winner == this)
+        transfer->onProgress(dlnow, transfer->elapsedMs());
+    return transfer->isCancelRequested() || abandoned ? 1 : 0;
+}
+
+// ---------- curl 回调 ----------
+static size_t writeCallback(char* data, size_t size, size_t nmemb, void* userp)
+{
+    return ((AIAttempt*)userp)->write(data, size * nmemb);
+}
+static int progressCallback(void* userp, curl_off_t, curl_off_t dlnow, curl_off_t, curl_off_t)
+{
+    return ((AIAttempt*)userp)->progress((long long)dlnow);
+}
+
+static double msBetween(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// ---------- AITransport ----------
+AITransport::AITransport()
+{
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    share = curl_share_init();
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);  // HTTP/2 下多个请求复用一个连接
+
+    worker = std::thread(&AITransport::loop, this);
+}
+AITransport::~AITransport()
+{
+    stopping = true;
+    wakeup();
+    if (worker.joinable()) worker.join();
+
+    // finish 会从 running 中移除传输
+    while (!running.empty())
+        finish(running.back(), CURLE_ABORTED_BY_CALLBACK);
+    for (auto& t : pending) {
+        t->cancelRequested = true;
+        finish(t, CURLE_ABORTED_BY_CALLBACK);
+    }
+    for (CURL* e : idleHandles)
+        curl_easy_cleanup(e);
+    curl_multi_cleanup(multi);
+    curl_share_cleanup(share);
+    curl_global_cleanup();
+}
+
+void AITransport::submit(const AITransferPtr& t)
+{
+    t->owner = this;
+    t->submitTime = std::chrono::steady_clock::now();
+    active++;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        pending.push_back(t);
+    }
+    wakeup();
+}
+void AITransport::wakeup()
+{
+    curl_multi_wakeup(multi);
+}
+int AITransport::activeCount()
+{
+    return active;
+}
+
+void AITransport::loop()
+{
+    while (!stopping) {
+        std::deque<AITransferPtr> incoming;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            incoming.swap(pending);
+        }
+        for (auto& t : incoming)
+            start(t);
+
+        // 取消的传输立即结束；移除对冲中落败的请求；到时间的重试与对冲
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < running.size();) {
+            AITransferPtr t = running[i];
+            if (t->isCancelRequested()) {
+                finish(t, CURLE_ABORTED_BY_CALLBACK);
+                continue;
+            }
+            for (size_t k = 0; k < t->live.size();) {
+                if (t->live[k]->abandoned)
+                    release(t->live[k]);
+                else
+                    k++;
+            }
+            if (t->live.empty()) {
+                if (now >= t->retryAt && !launch(t.get(), false)) {
+                    finish(t, CURLE_FAILED_INIT);
+                    continue;
+                }
+            }
+            else if (t->hedgeAfterMs > 0 && !t->hedged && !t->winner && !t->live[0]->held
+                && msBetween(t->live[0]->startTime, now) >= t->hedgeAfterMs) {
+                t->hedged = true;
+                launch(t.get(), true);
+            }
+            i++;
+        }
+
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+
+        CURLMsg* msg;
+        int left;
+        while ((msg = curl_multi_info_read(multi, &left))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL* easy = msg->easy_handle;
+            int code = msg->data.result;
+            AIAttempt* a = nullptr;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char**)&a);
+            if (a) attemptDone(a, code);
+        }
+
+        // 等待套接字事件、curl 内部超时、wakeup，或下一次重试 / 对冲的时间
+        curl_multi_poll(multi, nullptr, 0, nextTimerMs(), nullptr);
+    }
+}
+
+int AITransport::nextTimerMs()
+{
+    double wait = 100;
+    auto now = std::chrono::steady_clock::now();
+    for (auto& t : running) {
+        double ms = wait;
+        if (t->live.empty())
+            ms = msBetween(now, t->retryAt);
+        else if (t->hedgeAfterMs > 0 && !t->hedged && !t->winner)
+            ms = t->hedgeAfterMs - msBetween(t->live[0]->startTime, now);
+        if (ms < wait) wait = ms > 0 ? ms : 0;
+    }
+    return (int)wait;
+}
+
+void AITransport::start(const AITransferPtr& t)
+{
+    if (t->isCancelRequested()) {
+        finish(t, CURLE_ABORTED_BY_CALLBACK);
+        return;
+    }
+    t->startTime = std::chrono::steady_clock::now();
+    t->queueMs = msBetween(t->submitTime, t->startTime);
+    running.push_back(t);
+    if (!launch(t.get(), false))
+        finish(t, CURLE_FAILED_INIT);
+}
+
+bool AITransport::launch(AITransfer* t, bool hedge)
+{
+    CURL* easy;
+    if (!idleHandles.empty()) {
+        easy = idleHandles.back();
+        idleHandles.pop_back();
+        curl_easy_reset(easy);
+    }
+    else
+        easy = curl_easy_init();
+    if (!easy)
+        return false;
+
+    AIAttempt* a = new AIAttempt();
+    a->transfer = t;
+    a->easy = easy;
+    a->isHedge = hedge;
+    a->startTime = std::chrono::steady_clock::now();
+    curl_slist* list = nullptr;
+    for (auto& h : t->headers)
+        list = curl_slist_append(list, h.c_str());
+    a->headerList = list;
+
+    // 超时按整个传输计算：重试与对冲只能使用剩下的时间
+    long remaining = (long)(t->timeoutMs - msBetween(t->startTime, a->startTime));
+    if (remaining < 1) remaining = 1;
+
+    curl_easy_setopt(easy, CURLOPT_URL, t->url.c_str());
+    curl_easy_setopt(easy, CURLOPT_POST, 1L);
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDS, t->body.c_str());
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE, (long)t->body.size());
+    curl_easy_setopt(easy, CURLOPT_HTTPHEADER, list);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, remaining);
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, (long)t->connectTimeoutMs);
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);   // 多线程中不能使用信号实现超时
+    curl_easy_setopt(easy, CURLOPT_SHARE, share);
+    curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);  // 不支持时自动回退 HTTP/1.1
+    // HTTPS 时等待 ALPN 协商结果，能用 HTTP/2 就复用同一连接；明文 HTTP/1.1 下等待会使请求串行，不设置
+    if (t->url.compare(0, 8, "https://") == 0)
+        curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPIDLE, 30L);
+    curl_easy_setopt(easy, CURLOPT_TCP_KEEPINTVL, 15L);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, a);
+    curl_easy_setopt(easy, CURLOPT_XFERINFOFUNCTION, progressCallback);
+    curl_easy_setopt(easy, CURLOPT_XFERINFODATA, a);
+    curl_easy_setopt(easy, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, a);
+
+    curl_multi_add_handle(multi, easy);
+    t->live.push_back(a);
+    t->attempts++;
+    return true;
+}
+
+void AITransport::release(AIAttempt* a)
+{
+    AITransfer* t = a->transfer;
+    curl_multi_remove_handle(multi, a->easy);
+    idleHandles.push_back(a->easy);
+    curl_slist_free_all((curl_slist*)a->headerList);
+    for (size_t i = 0; i < t->live.size(); i++) {
+        if (t->live[i] == a) {
+            t->live.erase(t->live.begin() + i);
+            break;
+        }
+    }
+    if (t->winner == a) t->winner = nullptr;
+    delete a;
+}
+
+int AITransport::retryDelayMs(AITransfer* t, AIAttempt* a)
+{
+    // Retry-After（秒数或 HTTP 日期，curl 已换算成秒）优先；应答没有内容时也可能带这个头
+    curl_off_t after = 0;
+    if (curl_easy_getinfo(a->easy, CURLINFO_RETRY_AFTER, &after) == CURLE_OK && after > 0)
+        return (int)(after * 1000);
+    long long delay = (long long)t->retryDelayMs << t->retried;
+    if (delay > t->maxRetryDelayMs) delay = t->maxRetryDelayMs;
+    // 抖动：同时失败的请求不在同一时刻重试
+    static std::mt19937 rng(std::random_device{}());
+    delay += std::uniform_int_distribution<long long>(0, delay / 4)(rng);
+    return (int)delay;
+}
+
+void AITransport::attemptDone(AIAttempt* a, int code)
+{
+    AITransfer* t = a->transfer;
+    AITransferPtr keep;
+    for (auto& r : running) {
+        if (r.get() == t) {
+            keep = r;
+            break;
+        }
+    }
+    if (!keep) {
+        release(a);
+        return;
+    }
+    // 对冲中落败的一方
+    if (a->abandoned || (t->winner && t->winner != a)) {
+        release(a);
+        return;
+    }
+    // 已经交付过数据，或没有可重试的失败：这就是最终结果
+    // 状态码在这里判断：429 / 5xx 的应答可能没有内容（代理、网关），不会经过 write
+    long status = 0;
+    curl_easy_getinfo(a->easy, CURLINFO_RESPONSE_CODE, &status);
+    bool failed = a->held || (code == CURLE_OK && retryableStatus(status))
+        || (code != CURLE_OK && code != CURLE_ABORTED_BY_CALLBACK && code != CURLE_WRITE_ERROR);
+    if (t->winner == a || t->isCancelRequested() || !failed) {
+        finish(keep, code, a);
+        return;
+    }
+    // 对冲的另一方还在进行，由它决定结果
+    if (t->live.size() > 1) {
+        release(a);
+        return;
+    }
+    int delay = retryDelayMs(t, a);
+    double left = t->timeoutMs - t->elapsedMs();
+    if (t->retried < t->retries && delay + 1000 < left) {
+        t->retried++;
+        t->retryWaitMs += delay;
+        t->retryAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+        release(a);
+        return;
+    }
+    // 不再重试：保留的错误应答交给调用者
+    if (a->held && t->onData && !a->heldBody.empty())
+        t->onData(a->heldBody.data(), a->heldBody.size());
+    finish(keep, code, a);
+}
+
+void AITransport::finish(const AITransferPtr& t, int code, AIAttempt* last)
+{
+    AITransferPtr keep = t;   // t 可能引用 running 中的元素，下面会被移除
+    AIAttempt* info = last ? last : keep->winner ? keep->winner : keep->live.empty() ? nullptr : keep->live[0];
+    if (info) {
+        // curl 的时间从该次请求开始算起，换算到从第一次请求开始
+        long newConnects = 0;
+        double nameLookup = 0, connect = 0, appConnect = 0, firstByte = 0, total = 0;
+        double offset = msBetween(keep->startTime, info->startTime);
+        curl_easy_getinfo(info->easy, CURLINFO_RESPONSE_CODE, &keep->httpStatus);
+        curl_easy_getinfo(info->easy, CURLINFO_NAMELOOKUP_TIME, &nameLookup);
+        curl_easy_getinfo(info->easy, CURLINFO_CONNECT_TIME, &connect);
+        curl_easy_getinfo(info->easy, CURLINFO_APPCONNECT_TIME, &appConnect);
+        curl_easy_getinfo(info->easy, CURLINFO_STARTTRANSFER_TIME, &firstByte);
+        curl_easy_getinfo(info->easy, CURLINFO_TOTAL_TIME, &total);
+        curl_easy_getinfo(info->easy, CURLINFO_NUM_CONNECTS, &newConnects);
+        keep->nameLookupMs = offset + nameLookup * 1000;
+        keep->connectMs = offset + connect * 1000;
+        keep->appConnectMs = appConnect > 0 ? offset + appConnect * 1000 : 0;
+        keep->firstByteMs = offset + firstByte * 1000;
+        keep->totalMs = offset + total * 1000;
+        keep->reused = newConnects == 0;
+        keep->hedgeWon = info->isHedge;
+    }
+    while (!keep->live.empty())
+        release(keep->live.back());
+    for (size_t i = 0; i < running.size(); i++) {
+        if (running[i] == keep) {
+            running.erase(running.begin() + i);
+            break;
+        }
+    }
+
+    keep->curlCode = code;
+    keep->cancelled = keep->isCancelRequested();
+    keep->timedOut = code == CURLE_OPERATION_TIMEDOUT;
+    if (keep->cancelled)
+        keep->error = "cancelled";
+    else if (code != CURLE_OK)
+        keep->error = curl_easy_strerror((CURLcode)code);
+
+    if (keep->onDone) keep->onDone(*keep);
+    {
+        std::lock_guard<std::mutex> lk(keep->m);
+        keep->done = true;
+    }
+    keep->cv.notify_all();
+    active--;
+}
@@ -0,0 +1,145 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+// 与 curl.h 中的声明一致；头文件里不引入 curl.h
+typedef void CURL;
+typedef void CURLM;
+typedef void CURLSH;
+
+class AITransport;
+class AITransfer;
+
+// 一次实际发出的 HTTP 请求：重试与对冲时同一个 AITransfer 依次或同时有多个
+struct AIAttempt
+{
+    AITransfer* transfer = nullptr;
+    CURL* easy = nullptr;
+    void* headerList = nullptr;     // curl_slist*
+    bool isHedge = false;
+    bool held = false;              // 应答状态可重试：内容先留在 heldBody，不交给 onData
+    bool abandoned = false;         // 对冲中落败，等待事件循环移除
+    std::string heldBody;
+    std::chrono::steady_clock::time_point startTime;
+
+    // curl 写入 / 进度回调的处理，在事件循环线程中调用
+    size_t write(const char* data, size_t n);
+    int progress(long long dlnow);
+};
+
+// 一次 HTTP POST 传输：调用者填写请求与回调，AITransport 在事件循环线程中执行并写回结果
+class AITransfer
+{
+public:
+    // ---------- 请求 ----------
+    std::string url;
+    std::vector<std::string> headers;
+    std::string body;
+    int timeoutMs = 30000;     // 整个传输（含重试）的超时
+    int connectTimeoutMs = 0;  // 建立连接的超时，0 为 curl 默认值
+
+    // ---------- 重试与对冲（在事件循环中完成，调用者只看到最终结果） ----------
+    // 连接失败、429、5xx 时重试，只在还没有向 onData 交付任何数据时进行；可重试状态的应答内容先保留，
+    // 不再重试时才交给 onData。等待时间从 retryDelayMs 开始每次加倍，加 0~25% 随机抖动，
+    // 应答带 Retry-After 时按其等待；剩余时间不够时不再重试
+    int retries = 0;
+    int retryDelayMs = 500;
+    int maxRetryDelayMs = 10000;
+    // 大于 0 时：开始执行这么久仍未收到应答，再发一个相同的请求，先收到应答的一方继续，另一方取消
+    // 对冲请求可能被服务端完整处理并计费，只用于延迟敏感的请求
+    int hedgeAfterMs = 0;
+
+    // ---------- 回调（都在事件循环线程中调用） ----------
+    std::function<void(const char* data, size_t len)> onData;       // 收到应答数据
+    std::function<void(long long received, double elapsedMs)> onProgress;  // 传输进度
+    std::function<void(AITransfer& t)> onDone;                       // 传输结束（成功、失败或取消）
+
+    // ---------- 结果 ----------
+    int curlCode = 0;          // CURLcode
+    long httpStatus = 0;
+    bool cancelled = false;
+    bool timedOut = false;
+    std::string error;         // 失败时的错误描述
+    double queueMs = 0;        // 提交到开始执行的等待
+    double nameLookupMs = 0;   // 以下为从第一次请求开始算起的累计时间（重试时含之前的请求与等待）：DNS 解析完成
+    double connectMs = 0;      // TCP 连接完成
+    double appConnectMs = 0;   // TLS 握手完成（明文 HTTP 为 0）
+    double firstByteMs = 0;    // 首字节时间
+    double totalMs = 0;        // 总耗时
+    bool reused = false;       // 是否复用了已有连接
+    int attempts = 0;          // 实际发出的请求数（含重试与对冲）
+    bool hedged = false;       // 是否发出过对冲请求
+    bool hedgeWon = false;     // 结果是否来自对冲请求
+    double retryWaitMs = 0;    // 重试前等待的累计时间
+
+    // 请求取消，可在任意线程调用
+    void cancel();
+    bool isCancelRequested() const { return cancelRequested; }
+    // 等待传输结束，超时返回 false；timeoutMs < 0 表示一直等待
+    bool wait(int timeoutMs = -1);
+    bool isDone() const { return done; }
+    // 从开始执行到现在的毫秒数
+    double elapsedMs() const;
+private:
+    friend class AITransport;
+    friend struct AIAttempt;
+    AITransport* owner = nullptr;
+    std::vector<AIAttempt*> live;     // 正在执行的请求（对冲时两个）
+    AIAttempt* winner = nullptr;      // 已向 onData 交付数据的请求
+    int retried = 0;
+    std::chrono::steady_clock::time_point retryAt;   // 等待重试时的发起时间
+    std::chrono::steady_clock::time_point submitTime;
+    std::chrono::steady_clock::time_point startTime;  // 第一次请求开始执行的时间
+    std::atomic<bool> cancelRequested{ false };
+    std::atomic<bool> done{ false };
+    std::mutex m;
+    std::condition_variable cv;
+};
+typedef std::shared_ptr<AITransfer> AITransferPtr;
+
+// AITransport：基于 curl multi 的后台事件循环，所有 AI 请求在同一个线程中并发执行
+// 连接缓存由 multi 句柄保存，DNS 缓存与 TLS 会话通过 share 句柄共享，easy 句柄复用
+class AITransport
+{
+public:
+    AITransport();
+    ~AITransport();
+
+    // 提交传输，立即返回；结果通过 t->onDone / t->wait() 获取
+    void submit(const AITransferPtr& t);
+    // 唤醒事件循环（取消请求时调用）
+    void wakeup();
+    // 当前正在执行与排队的传输数
+    int activeCount();
+private:
+    CURLM* multi = nullptr;
+    CURLSH* share = nullptr;
+    std::thread worker;
+    std::atomic<bool> stopping{ false };
+    std::mutex mtx;
+    std::deque<AITransferPtr> pending;    // 等待加入 multi 的传输
+    std::vector<AITransferPtr> running;   // 执行中与等待重试的传输，只在事件循环线程中访问
+    std::vector<CURL*> idleHandles;       // 可复用的 easy 句柄
+    std::atomic<int> active{ 0 };
+
+    void loop();
+    void start(const AITransferPtr& t);
+    // 为传输发出一次请求，失败返回 false
+    bool launch(AITransfer* t, bool hedge);
+    void release(AIAttempt* a);
+    // 一次请求结束：决定完成、重试，或（对冲中）等待另一方
+    void attemptDone(AIAttempt* a, int code);
+    int retryDelayMs(AITransfer* t, AIAttempt* a);
+    // 传输结束：last 为最终结果所在的请求，用它填写耗时与状态
+    void finish(const AITransferPtr& t, int code, AIAttempt* last = nullptr);
+    // 距下一次重试或对冲的毫秒数，用于 poll 超时
+    int nextTimerMs();
+};
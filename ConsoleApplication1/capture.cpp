@@ -0,0 +1,121 @@
+﻿#include "capture.h"
+#include <chrono>
+#include <fstream>
+
+TriggerCapture::TriggerCapture() : stopping(false)
+{
+}
+void TriggerCapture::stop()
+{
+    stopping = true;
+}
+bool TriggerCapture::run(PLCClient& plc, const CaptureConfig& cfg, CaptureResult& result)
+{
+    using namespace std::chrono;
+    result = CaptureResult();
+    stopping = false;
+    if (!plc.isConnected() || cfg.size <= 0 || cfg.preSamples < 0 || cfg.postSamples < 0)
+        return false;
+
+    int area, dbNumber, start, bitIndex, dataSize;
+    if (!plc.parseAddress(cfg.trigger, area, dbNumber, start, bitIndex, dataSize) || bitIndex < 0)
+        return false;
+
+    // 预分配：触发前 + 触发样本 + 触发后，保证触发附近的样本不会被覆盖
+    int capacity = cfg.preSamples + 1 + cfg.postSamples;
+    ring.assign((size_t)capacity * cfg.size, 0);
+    stamps.assign(capacity, 0);
+    trigBits.assign(capacity, 0);
+
+    uint8_t trigByte = 0;
+    PLCDataItem items[2] = {
+        { area, dbNumber, start, 1, -1, &trigByte, 0 },
+        { S7AreaDB, cfg.dbNumber, cfg.start, cfg.size, -1, nullptr, 0 },
+    };
+
+    // 先读一次：DB 不存在或窗口超出 DB 长度时直接返回，不进入采样循环
+    items[1].data = ring.data();
+    if (!plc.read(items)) {
+        result.readErrors++;
+        return false;
+    }
+
+    auto t0 = steady_clock::now();
+    auto deadline = t0 + milliseconds(cfg.timeoutMs);
+    int errorRun = 0;          // 连续读取失败次数
+    long long head = 0;        // 已写入的样本总数，下一个槽位为 head % capacity
+    long long trigIndex = -1;  // 触发样本的序号
+    int prev = -1;             // 上一个样本的触发位，-1 表示还没有样本（避免开始时已为 1 被误判）
+
+    while (!stopping) {
+        int slot = (int)(head % capacity);
+        items[1].data = &ring[(size_t)slot * cfg.size];
+        result.samples++;
+
+        if (!plc.read(items)) {
+            result.readErrors++;
+            // 连接断开时 Snap7 的 isConnected 仍可能为 true，按连续失败次数与截止时间中止
+            if (!plc.isConnected() || ++errorRun >= cfg.maxReadErrors || steady_clock::now() > deadline) {
+                result.aborted = trigIndex >= 0;
+                break;
+            }
+            continue;
+        }
+        errorRun = 0;
+
+        auto now = steady_clock::now();
+        int bit = (trigByte >> bitIndex) & 1;
+        stamps[slot] = duration_cast<microseconds>(now - t0).count();
+        trigBits[slot] = (uint8_t)bit;
+        head++;
+
+        if (trigIndex < 0 && prev == 0 && bit == 1) {
+            trigIndex = head - 1;
+            deadline = now + milliseconds(cfg.timeoutMs);   // 触发后的采集另算一段时间
+        }
+        prev = bit;
+
+        if (trigIndex >= 0 && head - 1 - trigIndex >= cfg.postSamples)
+            break;
+        if (now > deadline) {
+            result.aborted = trigIndex >= 0;
+            break;
+        }
+    }
+
+    double sec = duration<double>(steady_clock::now() - t0).count();
+    result.sampleRateHz = sec > 0 ? result.samples / sec : 0;
+    if (trigIndex < 0) return false;
+
+    long long first = trigIndex - cfg.preSamples;
+    if (first < 0) first = 0;
+    result.triggered = true;
+    result.preCount = (int)(trigIndex - first);
+    result.postCount = (int)(head - trigIndex);
+    return dump(cfg, (int)(first % capacity), (int)(head - first), (int)(trigIndex % capacity));
+}
+// 写出 CSV：相对触发的样本序号、相对触发的时间（微秒）、触发位、窗口数据（十六进制）
+bool TriggerCapture::dump(const CaptureConfig& cfg, int first, int count, int trigSlot)
+{
+    std::ofstream out(cfg.file);
+    if (!out) return false;
+
+    int capacity = (int)stamps.size();
+    out << "# trigger=" << cfg.trigger << " db=" << cfg.dbNumber << " start=" << cfg.start
+        << " size=" << cfg.size << " pre=" << cfg.preSamples << " post=" << cfg.postSamples << "\n";
+    out << "index,time_us,trigger,data\n";
+
+    static const char hexDigits[] = "0123456789ABCDEF";
+    int trigPos = (trigSlot - first + capacity) % capacity;
+    for (int i = 0; i < count; i++) {
+        int slot = (first + i) % capacity;
+        out << i - trigPos << ',' << stamps[slot] - stamps[trigSlot] << ',' << (int)trigBits[slot] << ',';
+        const uint8_t* p = &ring[(size_t)slot * cfg.size];
+        for (int b = 0; b < cfg.size; b++) {
+            if (b) out << ' ';
+            out << hexDigits[p[b] >> 4] << hexDigits[p[b] & 0xF];
+        }
+        out << '\n';
+    }
+    return (bool)out;
+}
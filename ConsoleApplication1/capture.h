@@ -0,0 +1,53 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include "plcclient.h"
+
+// 触发采集参数
+struct CaptureConfig
+{
+    std::string trigger;     // 触发位地址，如 "M10.0"、"DB1.DBX0.0"
+    int dbNumber = 1;        // 采集的 DB 块号
+    int start = 0;           // 起始字节
+    int size = 16;           // 窗口字节数
+    int preSamples = 100;    // 触发前保留的样本数
+    int postSamples = 100;   // 触发后继续采集的样本数
+    int timeoutMs = 60000;   // 等待触发的最长时间，触发后的采集也不超过这个时间
+    int maxReadErrors = 20;  // 连续读取失败达到该次数时中止
+    std::string file;        // 输出文件（CSV）
+};
+
+// 一次采集的结果
+struct CaptureResult
+{
+    bool triggered = false;  // 是否捕获到上升沿
+    int preCount = 0;        // 实际写出的触发前样本数
+    int postCount = 0;       // 实际写出的触发后样本数（含触发样本）
+    long long samples = 0;   // 总采样次数
+    int readErrors = 0;      // 读取失败次数
+    bool aborted = false;    // 因连续读取失败或触发后超时而提前结束（已采到的样本仍会写出）
+    double sampleRateHz = 0; // 平均采样频率
+};
+
+// TriggerCapture：以连接允许的最快速度轮询触发位，同时把 DB 窗口写入环形缓冲区
+// 触发位与 DB 窗口在同一个批量请求中读取，保证每个样本的一致性
+// 缓冲区在开始前一次分配，采样循环中不再分配内存
+class TriggerCapture
+{
+public:
+    TriggerCapture();
+
+    // 阻塞运行直到触发并采满触发后样本、超时或被 stop() 中止
+    // 捕获到触发时把前后样本写入 cfg.file
+    bool run(PLCClient& plc, const CaptureConfig& cfg, CaptureResult& result);
+    // 从其它线程中止采集
+    void stop();
+private:
+    std::atomic<bool> stopping;
+    std::vector<uint8_t> ring;       // 样本数据，capacity 个槽位，每槽 size 字节
+    std::vector<long long> stamps;   // 每个槽位的采样时间（微秒）
+    std::vector<uint8_t> trigBits;   // 每个槽位的触发位
+
+    bool dump(const CaptureConfig& cfg, int first, int count, int trigSlot);
+};
@@ -1,7 +1,15 @@
 ﻿#include "console.h"
 #include <windows.h>
+#include <conio.h>
 #include <iostream>
 #include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include "simplc.h"
+#include "modbus.h"
+#include "capture.h"
+#include "plctools.h"
 void Console::printGBK(const std::string& text)
 {
     HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -49,6 +57,18 @@ Console::Console() {}
 // ==========================================================
 void Console::run()
 {
+    // 恢复上次退出前的对话历史（只读取日志尾部，耗时与日志长度无关）
+    int resumed = ai.openLog("aihistory.log");
+    if (resumed > 0)
+    {
+        std::ostringstream info;
+        info << "已恢复上次的对话历史 " << resumed << " 条（~" << ai.getHistoryTokens() << " tokens，"
+            << ai.getLogStats().resumeMs << " ms）\n";
+        printGBK(info.str());
+    }
+    // 接口配置：对话用云端接口，AI 控制优先用局域网内的推理服务
+    loadProviders("providers.ini");
+
     while (true)
     {
         showMainHeader();
@@ -123,6 +143,8 @@ void Console::menuPLCConnect()
 {
     printGBK("\n--- PLC 连接 ---\n");
     printGBK("输入 IP 地址连接 PLC，例如：192.168.10.1\n");
+    printGBK("输入 sim 使用内置仿真 PLC（无需网络）\n");
+    printGBK("输入 mb:IP[:端口][/站号] 连接 Modbus TCP 设备，mbsim 连接本地 Modbus 替身\n");
     printGBK("输入 break0 返回主菜单\n");
     printGBK("IP> ");
 
@@ -132,6 +154,37 @@ void Console::menuPLCConnect()
     if (checkBreak(ip))
         return;
 
+    if (ip == "sim")
+    {
+        // 仿真逻辑：I0.0 跟随 Q0.0，MW100 为扫描计数
+        SimulatedPLC* sim = new SimulatedPLC();
+        sim->setLogic([](SimMemory& m) {
+            m.inputs[0] = (m.inputs[0] & 0xFE) | (m.outputs[0] & 0x01);
+            uint16_t n = (uint16_t)((m.markers[100] << 8) | m.markers[101]) + 1;
+            m.markers[100] = n >> 8;
+            m.markers[101] = n & 0xFF;
+        });
+        plc.setBackend(sim);
+    }
+    else if (ip == "mbsim" || ip.rfind("mb:", 0) == 0)
+    {
+        if (ip == "mbsim")
+        {
+            mbServer.setLoopback(true);
+            if (!mbServer.start())
+            {
+                printGBK("本地 Modbus 替身启动失败。\n");
+                return;
+            }
+            ip = "127.0.0.1:" + std::to_string(mbServer.getPort());
+        }
+        else
+            ip = ip.substr(3);
+        plc.setBackend(new ModbusBackend());
+    }
+    else if (!dynamic_cast<Snap7Backend*>(plc.getBackend()))
+        plc.setBackend(new Snap7Backend());
+
     printGBK("尝试连接 PLC...\n");
 
     if (plc.connectPLC(ip, 0, 1))
@@ -140,6 +193,31 @@ void Console::menuPLCConnect()
         printGBK("PLC 连接失败，请检查 IP 或 PLCSIM。\n");
 }
 
+// 从配置文件选择主接口与控制接口，文件不存在时保持原设置
+bool Console::loadProviders(const std::string& file)
+{
+    AIProviderConfig config;
+    if (config.load(file) <= 0)
+        return false;
+    const AIProvider* primary = config.defaultProvider();
+    const AIProvider* fast = config.controlProvider();
+    if (primary)
+        ai.setProvider(*primary);
+    if (fast && fast != primary)
+        ai.setControlProvider(*fast);
+    else
+        ai.clearControlProvider();
+    hasAIKey = ai.getProvider().usable() || (ai.hasControlProvider() && ai.getControlProvider().usable());
+
+    std::string info = "已从 " + file + " 加载 " + std::to_string(config.all().size()) + " 个接口";
+    if (primary)
+        info += "，主接口 " + primary->name + "（" + primary->model + "）";
+    if (ai.hasControlProvider())
+        info += "，AI 控制优先使用 " + fast->name + "（" + fast->model + "）";
+    printGBK(info + "\n");
+    return true;
+}
+
 // ==========================================================
 // 2. 设置 AI Key
 // ==========================================================
@@ -147,6 +225,9 @@ void Console::menuAIKey()
 {
     printGBK("\n--- 设置 AI Key ---\n");
     printGBK("输入您的 DeepSeek API Key：\n");
+    printGBK("输入 mock 使用本地模拟接口（无需网络与密钥）\n");
+    printGBK("输入 url:地址 指定兼容接口地址，例如 url:http://127.0.0.1:8000/v1/chat/completions\n");
+    printGBK("输入 providers 文件名 加载接口配置（地址、模型、Key、是否流式 / 函数调用，AI 控制优先使用的本地接口）\n");
     printGBK("输入 break0 返回主菜单\n");
     printGBK("KEY> ");
 
@@ -156,6 +237,47 @@ void Console::menuAIKey()
     if (checkBreak(key))
         return;
 
+    if (key.rfind("providers ", 0) == 0)
+    {
+        if (!loadProviders(key.substr(10)))
+            printGBK("无法加载接口配置。\n");
+        return;
+    }
+    if (key.rfind("url:", 0) == 0)
+    {
+        ai.setEndpoint(key.substr(4));
+        printGBK("接口地址已设置为 " + ai.getEndpoint() + "\n");
+        return;
+    }
+    if (key == "mock")
+    {
+        // 模拟接口：首 token 300 ms、50 token/s，按关键字返回控制指令
+        if (!mockAI.start())
+        {
+            printGBK("本地模拟接口启动失败。\n");
+            return;
+        }
+        mockAI.clearReplies();
+        mockAI.addReply(u8"打开", u8"W: 已打开输出 Q0.0\nC: write Q0.0 1");
+        mockAI.addReply(u8"关闭", u8"W: 已关闭输出 Q0.0\nC: write Q0.0 0");
+        mockAI.addReply(u8"状态", u8"W: 正在读取 Q0.0 的状态\nC: read Q0.0");
+        mockAI.addReply(u8"计数", u8"W: 正在读取扫描计数 MW100\nC: read MW100");
+        // 指令在前、说明在后：流式回复中 C: 行结束即可提前执行
+        mockAI.addReply(u8"启动", u8"W: 正在启动输出 Q0.1\nC: write Q0.1 1\n"
+            u8"Q0.1 接通后对应的执行机构开始动作，请确认现场安全；需要停止时输入 关闭 Q0.1 即可。");
+        // 请求带 tools 时按函数调用返回
+        mockAI.addToolReply(u8"打开", "write_tags", "{\"writes\":[{\"address\":\"Q0.0\",\"value\":1}]}");
+        mockAI.addToolReply(u8"关闭", "write_tags", "{\"writes\":[{\"address\":\"Q0.0\",\"value\":0}]}");
+        mockAI.addToolReply(u8"状态", "read_tags", "{\"addresses\":[\"I0.0\",\"Q0.0\",\"MW100\"]}");
+        mockAI.addToolReply(u8"计数", "read_tags", "{\"addresses\":[\"MW100\"]}");
+        // 多步查询：先看液位与进水阀，再看泵与计数
+        mockAI.addToolReply(u8"水箱", "read_tags", "{\"addresses\":[\"I0.0\",\"Q0.1\"]}");
+        mockAI.addToolReply(u8"水箱", "read_tags", "{\"addresses\":[\"Q0.0\",\"MW100\"]}", 1);
+        ai.setEndpoint(mockAI.getEndpoint());
+        key = "mock";
+        printGBK("本地模拟接口：" + mockAI.getEndpoint() + "\n");
+    }
+
     ai.setAPIKey(key);
     hasAIKey = true;
 
@@ -174,8 +296,12 @@ void Console::menuPLCManual()
     }
 
     printGBK("\n--- 手动控制 PLC ---\n");
-    printGBK("读：read I0.0\n");
+    printGBK("读：read I0.0（多个地址：read I0.0 MW10 DB1.DBW2）\n");
     printGBK("写：write Q0.0 1\n");
+    printGBK("压测：bench MW0 10000\n");
+    printGBK("程序块镜像：blocks [目录]（只上传有变化的块）\n");
+    printGBK("触发采集：capture M10.0 1 0 32 100 100 fault.csv\n");
+    printGBK("    （触发位 DB号 起始字节 字节数 触发前样本 触发后样本 输出文件）\n");
     printGBK("输入 break0 返回主菜单\n");
 
     while (true)
@@ -194,16 +320,36 @@ void Console::menuPLCManual()
 
         if (op == "read")
         {
+            std::vector<std::string> addrs;
             std::string addr;
-            ss >> addr;
+            while (ss >> addr)
+                addrs.push_back(addr);
 
-            int val = 0;
-            if (plc.readAddress(addr, val))
+            if (addrs.size() <= 1)
             {
-                printGBK(addr + " = ");
-                std::cout << val << "\n";
+                int val = 0;
+                if (!addrs.empty() && plc.readAddress(addrs[0], val))
+                {
+                    printGBK(addrs[0] + " = ");
+                    std::cout << val << "\n";
+                }
+                else printGBK("读取失败\n");
+                continue;
+            }
+
+            // 多个地址走批量读取
+            std::vector<int32_t> vals;
+            std::vector<bool> ok;
+            plc.readAddresses(addrs, vals, &ok);
+            for (size_t i = 0; i < addrs.size(); i++)
+            {
+                if (ok[i])
+                {
+                    printGBK(addrs[i] + " = ");
+                    std::cout << vals[i] << "\n";
+                }
+                else printGBK(addrs[i] + " 读取失败\n");
             }
-            else printGBK("读取失败\n");
         }
         else if (op == "write")
         {
@@ -216,9 +362,69 @@ void Console::menuPLCManual()
             else
                 printGBK("写入失败\n");
         }
+        else if (op == "bench")
+        {
+            // 连续读取同一地址，统计吞吐
+            std::string addr;
+            int count = 1000;
+            ss >> addr >> count;
+
+            int ok = 0, val = 0;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int i = 0; i < count; i++)
+                if (plc.readAddress(addr, val)) ok++;
+            double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+            std::ostringstream out;
+            out << "完成 " << count << " 次读取，成功 " << ok << " 次，耗时 "
+                << sec * 1000 << " ms，" << (sec > 0 ? count / sec : 0) << " 次/秒\n";
+            printGBK(out.str());
+        }
+        else if (op == "blocks")
+        {
+            std::string dir = "blocks";
+            ss >> dir;
+
+            BlockSyncResult r;
+            if (!plc.syncBlocks(dir, r))
+            {
+                printGBK("同步失败：当前后端不支持程序块访问\n");
+                continue;
+            }
+            std::ostringstream out;
+            out << "共 " << r.listed << " 个块，上传 " << r.uploaded << " 个，未变 " << r.unchanged
+                << " 个，删除 " << r.removed << " 个，失败 " << r.failed << " 个，耗时 "
+                << r.seconds * 1000 << " ms\n";
+            printGBK(out.str());
+            for (auto& name : r.changed)
+                printGBK("  已变化：" + name + "\n");
+        }
+        else if (op == "capture")
+        {
+            CaptureConfig cfg;
+            cfg.file = "capture.csv";
+            ss >> cfg.trigger >> cfg.dbNumber >> cfg.start >> cfg.size
+                >> cfg.preSamples >> cfg.postSamples >> cfg.file;
+
+            printGBK("等待触发 " + cfg.trigger + " 上升沿...\n");
+            TriggerCapture cap;
+            CaptureResult r;
+            bool ok = cap.run(plc, cfg, r);
+
+            std::ostringstream out;
+            out << "采样 " << r.samples << " 次，" << r.sampleRateHz << " 次/秒，读取失败 " << r.readErrors << " 次\n";
+            if (ok)
+                out << "已触发，写出触发前 " << r.preCount << " 个、触发后 " << r.postCount << " 个样本到 " << cfg.file
+                    << (r.aborted ? "（读取中断，触发后样本不完整）" : "") << "\n";
+            else if (r.triggered)
+                out << "已触发，但写文件失败：" << cfg.file << "\n";
+            else
+                out << "未捕获到触发（超时、连续读取失败或参数 / DB 窗口错误）\n";
+            printGBK(out.str());
+        }
         else
         {
-            printGBK("未知指令，请使用 read / write\n");
+            printGBK("未知指令，请使用 read / write / bench / blocks / capture\n");
         }
     }
 }
@@ -235,6 +441,13 @@ void Console::menuAIDialog()
     }
 
     printGBK("\n--- AI 对话模式 ---\n");
+    printGBK("输入 cache on / cache off 开关本地回复缓存，cache 查看命中统计\n");
+    printGBK("输入 batch 文件名 批量提问（文件每行一个独立问题，UTF-8 编码）\n");
+    printGBK("输入 bench [次数] 测试请求耗时，bench json 测试应答解析耗时\n");
+    printGBK("输入 log 查看对话日志，log compact 压缩日志，new 开始新会话（清空历史）\n");
+    printGBK("输入 summary 查看历史摘要，summary on / summary off 开关自动摘要\n");
+    printGBK("输入 stats 查看请求耗时分解的百分位（DNS / TLS / 首 token / 生成速度 / 解析），stats clear 清空\n");
+    printGBK("输入 retry 次数 [等待ms] 设置失败重试，hedge on / hedge off 开关对冲请求（超过首 token p95 再发一份）\n");
     printGBK("输入 break0 返回主菜单\n");
 
     while (true)
@@ -247,16 +460,300 @@ void Console::menuAIDialog()
         if (checkBreak(msg))
             return;
 
+        if (msg == "cache on" || msg == "cache off" || msg == "cache")
+        {
+            if (msg == "cache on")
+                ai.enableCache("aicache.bin");
+            else if (msg == "cache off")
+                ai.disableCache();
+
+            AICacheStats cs = ai.getCacheStats();
+            std::ostringstream info;
+            info << "本地缓存：" << (ai.isCacheEnabled() ? "开启" : "关闭") << "，条目 " << cs.entries
+                << "，命中 " << cs.hits << "，未命中 " << cs.misses << "（过期 " << cs.expired << "），命中率 "
+                << (int)(cs.hitRatio() * 100) << "%\n";
+            printGBK(info.str());
+            continue;
+        }
+
+        if (msg == "log" || msg == "log compact")
+        {
+            if (msg == "log compact" && !ai.compactLog())
+                printGBK("日志压缩失败。\n");
+            AILogStats ls = ai.getLogStats();
+            std::ostringstream info;
+            info << "对话日志：" << (ai.isLogOpen() ? "aihistory.log" : "未打开") << "，记录 " << ls.records
+                << " 条，" << ls.fileBytes / 1024 << " KB，已压缩 " << ls.compactions << " 次\n";
+            printGBK(info.str());
+            continue;
+        }
+        if (msg == "summary" || msg == "summary on" || msg == "summary off")
+        {
+            if (msg != "summary")
+                ai.setSummarize(msg == "summary on");
+            std::string text = ai.getSummary();
+            printGBK("已摘要 " + std::to_string(ai.getSummaryCount()) + " 次，历史 ~"
+                + std::to_string(ai.getHistoryTokens()) + " tokens\n");
+            if (!text.empty())
+            {
+                printUTF8(text);
+                printGBK("\n");
+            }
+            continue;
+        }
+        if (msg == "stats" || msg == "stats clear")
+        {
+            if (msg == "stats clear")
+                ai.clearLatencyStats();
+            printAILatency();
+            continue;
+        }
+        if (msg == "retry" || msg.rfind("retry ", 0) == 0 || msg == "hedge on" || msg == "hedge off" || msg == "hedge")
+        {
+            if (msg.rfind("retry ", 0) == 0)
+            {
+                std::istringstream ss(msg.substr(6));
+                int n = -1, delay = ai.getRetryDelayMs();
+                if (!(ss >> n) || n < 0)
+                {
+                    printGBK("用法：retry 2 / retry 2 500\n");
+                    continue;
+                }
+                ss >> delay;
+                ai.setRetryPolicy(n, delay);
+            }
+            else if (msg != "retry" && msg != "hedge")
+                ai.setHedging(msg == "hedge on");
+            AILatencyStats st = ai.getLatencyStats();
+            std::ostringstream info;
+            info << "失败重试 " << ai.getRetries() << " 次，首次等待 " << ai.getRetryDelayMs() << " ms（有 Retry-After 时按其等待）；对冲请求："
+                << (ai.isHedging() ? "开启" : "关闭");
+            if (ai.isHedging())
+            {
+                AILatencyStats::Metric m = st.count(AILatencyStats::FirstToken) >= 20
+                    ? AILatencyStats::FirstToken : AILatencyStats::FirstByte;
+                int n = st.count(m);
+                if (n >= 20)
+                    info << "，阈值 " << (int)st.percentile(m, 95) << " ms（" << AILatencyStats::name(m) << " p95）";
+                else
+                    info << "（样本 " << n << " / 20，样本足够后生效）";
+            }
+            info << "\n已重试 " << st.retries() << " 次，对冲 " << st.hedges() << " 次，对冲胜出 " << st.hedgeWins() << " 次\n";
+            printGBK(info.str());
+            continue;
+        }
+        if (msg == "new")
+        {
+            ai.clearHistory();
+            printGBK("已开始新会话。\n");
+            continue;
+        }
+
+        if (msg == "bench json")
+        {
+            // 应答字段提取：拉取式扫描与 jsoncpp DOM 对比（不发网络请求）
+            JsonBenchResult jb = benchmarkJsonScan(20000);
+            std::ostringstream info;
+            info.setf(std::ios::fixed);
+            info.precision(0);
+            info << "每轮 " << jb.bytes << " 字节（4 个数据块），扫描 " << jb.scanNs << " ns，jsoncpp " << jb.jsoncppNs
+                << " ns，";
+            info.precision(1);
+            info << (jb.scanNs > 0 ? jb.jsoncppNs / jb.scanNs : 0) << " 倍，扫描吞吐 "
+                << (jb.scanNs > 0 ? jb.bytes / jb.scanNs * 1000 : 0) << " MB/s\n";
+            printGBK(info.str());
+            continue;
+        }
+
+        if (msg.rfind("bench", 0) == 0)
+        {
+            // 独立请求逐个发送（不带历史），统计端到端耗时
+            int n = atoi(msg.c_str() + 5);
+            if (n <= 0) n = 10;
+            AIBatchOptions opt;
+            opt.concurrency = 1;
+            opt.requestsPerMinute = 0;
+            opt.retries = 0;
+            std::vector<AIBatchResult> results = ai.askBatch(
+                std::vector<std::string>(n, u8"PLC 状态正常吗？"), "", opt);
+            double sum = 0, minMs = 1e9, maxMs = 0;
+            int failed = 0;
+            for (auto& r : results)
+            {
+                if (!r.ok) { failed++; continue; }
+                sum += r.totalMs;
+                if (r.totalMs < minMs) minMs = r.totalMs;
+                if (r.totalMs > maxMs) maxMs = r.totalMs;
+            }
+            int okCount = n - failed;
+            std::ostringstream info;
+            info << "请求 " << n << " 次，失败 " << failed << " 次";
+            if (okCount > 0)
+                info << "，平均 " << (int)(sum / okCount) << " ms，最小 " << (int)minMs << " ms，最大 " << (int)maxMs << " ms";
+            info << "\n";
+            printGBK(info.str());
+            continue;
+        }
+
+        if (msg.rfind("batch ", 0) == 0)
+        {
+            std::ifstream in(msg.substr(6));
+            if (!in)
+            {
+                printGBK("无法打开文件。\n");
+                continue;
+            }
+            std::vector<std::string> prompts;
+            std::string line;
+            while (std::getline(in, line))
+            {
+                if (prompts.empty() && line.rfind("\xEF\xBB\xBF", 0) == 0)
+                    line = line.substr(3);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (!line.empty()) prompts.push_back(line);
+            }
+
+            auto t0 = std::chrono::steady_clock::now();
+            std::vector<AIBatchResult> results = ai.askBatch(prompts, "", AIBatchOptions(),
+                [&](int done, int total) {
+                    printGBK("\r已完成 " + std::to_string(done) + "/" + std::to_string(total));
+                });
+            double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            printGBK("\n");
+
+            int failed = 0;
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                printGBK("[" + std::to_string(i + 1) + "] ");
+                printUTF8(prompts[i]);
+                printGBK("\n=> ");
+                printUTF8(results[i].text);
+                printGBK("\n");
+                if (!results[i].ok) failed++;
+            }
+            std::ostringstream info;
+            info << "（共 " << results.size() << " 条，失败 " << failed << " 条，总耗时 " << (int)(sec * 1000) << " ms）\n";
+            printGBK(info.str());
+            printAIUsage();
+            continue;
+        }
+
         std::string utf8msg = GBKtoUTF8(msg);
-        std::string reply = ai.ask(utf8msg);
+        // 流式输出：收到一段打印一段
         printGBK("ai> ");
-        printUTF8(reply);
+        // 回复在后台线程中接收，这里只等待并响应 break0
+        std::atomic<bool> streamed(false);
+        AIReplyPtr pending = ai.askAsync(utf8msg, "", [&](const std::string& text) {
+            streamed = true;
+            printUTF8(text);
+        });
+        std::string reply = waitAIReply(pending);
+        if (!streamed || !pending->succeeded())
+            printUTF8(reply);   // 错误信息等非流式结果
         printGBK("\n");
+        if (pending->isCancelled())
+            continue;
+
+        if (ai.lastFromCache())
+        {
+            printGBK("（本地缓存命中）\n");
+            continue;
+        }
+        std::ostringstream info;
+        info << "（请求 " << ai.getLastRequestBytes() << " 字节，首字节 " << (int)ai.getLastFirstByteMs()
+            << " ms，总耗时 " << (int)ai.getLastTotalMs() << " ms，"
+            << (ai.lastConnectionReused() ? "复用连接" : "新建连接")
+            << "，历史 ~" << ai.getHistoryTokens() << "/" << ai.getTokenBudget() << " tokens）\n";
+        printGBK(info.str());
+        printAIUsage();
+    }
+}
+
+// 等待异步回复；控制台线程不被阻塞，输入 break0 回车即取消请求
+std::string Console::waitAIReply(const AIReplyPtr& reply)
+{
+    std::string typed;
+    while (!reply->wait(50))
+    {
+        while (_kbhit())
+        {
+            int c = _getch();
+            if (c == '\r' || c == '\n')
+            {
+                if (checkBreak(typed))
+                {
+                    reply->cancel();
+                    printGBK("\n[已取消]");
+                }
+                typed.clear();
+            }
+            else if (c == '\b')
+            {
+                if (!typed.empty()) typed.pop_back();
+            }
+            else
+                typed += (char)c;
+        }
     }
+    return reply->get();
+}
+
+void Console::printAIUsage()
+{
+    AIUsage last = ai.getLastUsage();
+    AIUsage total = ai.getSessionUsage();
+    if (last.requests == 0)
+        return;
+
+    std::ostringstream info;
+    info.setf(std::ios::fixed);
+    info.precision(1);
+    info << "（输入 " << last.promptTokens << " tokens，缓存命中 " << last.cacheHitTokens
+        << "，输出 " << last.completionTokens << "；会话 " << total.requests << " 次，命中率 "
+        << total.hitRatio() * 100 << "%，输入 " << total.promptTokens << " / 输出 " << total.completionTokens;
+    info.precision(4);
+    info << " tokens，约 $" << total.cost << "）\n";
+
+    // 上一次请求的耗时分解：curl 各阶段为累计时间，复用连接时 DNS / TCP / TLS 为 0
+    AIRequestTiming t = ai.getLastTiming();
+    info.precision(1);
+    info << "（排队 " << t.queueMs << " / DNS " << t.dnsMs << " / TCP " << t.connectMs << " / TLS " << t.tlsMs
+        << " / 首字节 " << t.firstByteMs << " / 首 token " << t.firstTokenMs << " / 总 " << t.totalMs << " ms，"
+        << t.tokensPerSec() << " tokens/s，解析 " << t.parseMs << " ms，输出 " << t.printMs << " ms）\n";
+    if (t.attempts > 1)
+        info << "（发送 " << t.attempts << " 次，重试等待 " << t.retryWaitMs << " ms" << (t.hedged ? "，发出对冲请求" : "")
+            << (t.hedgeWon ? "，对冲请求胜出" : "") << "）\n";
+    printGBK(info.str());
+}
+
+// 最近请求各项指标的 p50 / p95 / p99
+void Console::printAILatency()
+{
+    AILatencyStats st = ai.getLatencyStats();
+    std::ostringstream info;
+    info.setf(std::ios::fixed);
+    info.precision(1);
+    info << "AI 请求 " << st.requests() << " 次，失败 " << st.failures() << " 次（统计最近 "
+        << st.count(AILatencyStats::Total) << " 次成功请求），重试 " << st.retries() << " 次，对冲 " << st.hedges()
+        << " 次（胜出 " << st.hedgeWins() << " 次）\n";
+    info << std::left << std::setw(12) << "" << std::right << std::setw(10) << "p50" << std::setw(10) << "p95"
+        << std::setw(10) << "p99" << std::setw(8) << "n" << "\n";
+    for (int m = 0; m < AILatencyStats::MetricCount; m++)
+    {
+        AILatencyStats::Metric metric = (AILatencyStats::Metric)m;
+        if (st.count(metric) == 0)
+            continue;
+        info << std::left << std::setw(12) << AILatencyStats::name(metric) << std::right;
+        for (double p : { 50.0, 95.0, 99.0 })
+            info << std::setw(10) << st.percentile(metric, p);
+        info << std::setw(8) << st.count(metric) << "\n";
+    }
+    info << "（时间单位 ms；重试或对冲过的请求只计入 total 等端到端指标；wait 为握手完成到首字节，generate 为首 token 到结束，tok/s 为生成速度，prompt / completion 为 token 数）\n";
+    printGBK(info.str());
 }
 
 // ==========================================================
-// 5. AI 自动控制 PLC（文本 W: + 控制 C: 格式）
+// 5. AI 自动控制 PLC（函数调用 read_tags / write_tags，文本 W: + C: 格式兜底）
 // ==========================================================
 void Console::menuAIControlPLC()
 {
@@ -272,12 +769,37 @@ void Console::menuAIControlPLC()
     }
 
     printGBK("\n--- AI 控制 PLC ---\n");
-    printGBK("AI 输出格式示例：\n");
+    printGBK("AI 通过 read_tags / write_tags 函数批量读写 PLC，一轮可读写多个地址\n");
+    printGBK("不支持函数调用的接口按文本格式输出：\n");
     printGBK("  W: 这是返回给用户的文本\n");
     printGBK("  C: write Q0.0 1\n");
-    printGBK("支持指令：read I0.0 / write Q0.0 1\n");
+    printGBK("简单读写（如 读 I0.0、把 Q0.1 置 1、打开 1号泵、toggle Q0.0）在本地直接执行，不经过 AI\n");
+    printGBK("输入 fast 查看快速通道统计，fast on / fast off 开关，tags 文件名 加载标签字典（每行 名称=地址）\n");
+    printGBK("输入 stats 查看 AI 请求耗时分解的百分位，stats clear 清空\n");
+    printGBK("输入 budget 查看多步函数调用的预算，budget steps/ms/tokens 数值 修改\n");
+    printGBK("流式回复中的 C: 行一结束就执行，输入 early 查看节省的时间，early on / early off 开关\n");
+    printGBK("输入 ctx 查看附加给 AI 的 PLC 当前值，ctx on / ctx off 开关，ctx 文件名 加载关注列表（每行 名称=地址）\n");
     printGBK("输入 break0 返回主菜单\n\n");
 
+    if (ai.hasControlProvider())
+    {
+        AIProvider fast = ai.getControlProvider();
+        printGBK("AI 控制优先使用 " + fast.name + "（" + fast.endpoint + "），不可用时改用 " + ai.getProvider().name
+            + "；输入 provider 查看切换次数\n\n");
+    }
+    if (intents.tagCount() == 0)
+    {
+        int n = intents.loadTags("tags.txt");
+        if (n > 0)
+            printGBK("已从 tags.txt 加载 " + std::to_string(n) + " 个标签\n\n");
+    }
+    if (plcContext.size() == 0)
+    {
+        int n = plcContext.load("context.txt");
+        if (n > 0)
+            printGBK("已从 context.txt 加载 " + std::to_string(n) + " 个关注地址\n\n");
+    }
+
     while (true)
     {
         printGBK("ai-control> ");
@@ -285,15 +807,267 @@ void Console::menuAIControlPLC()
         std::getline(std::cin, userText);
         if (checkBreak(userText)) return;
 
+        if (userText == "fast" || userText == "fast on" || userText == "fast off")
+        {
+            if (userText != "fast")
+                fastPath = userText == "fast on";
+            const IntentStats& st = intents.getStats();
+            std::ostringstream info;
+            info.setf(std::ios::fixed);
+            info.precision(1);
+            info << "快速通道：" << (fastPath ? "开启" : "关闭") << "，标签 " << intents.tagCount() << " 个，输入 "
+                << st.inputs << " 次，本地执行 " << st.hits << " 次（" << st.hitRatio() * 100 << "%）";
+            if (st.hits > 0)
+                info << "，平均 " << st.fastMs / st.hits << " ms";
+            if (st.aiTurns > 0)
+                info << "；AI 平均 " << st.aiMs / st.aiTurns << " ms，约节省 " << st.savedMs() / 1000 << " s";
+            info << "\n\n";
+            printGBK(info.str());
+            continue;
+        }
+        if (userText == "ctx" || userText == "ctx on" || userText == "ctx off")
+        {
+            if (userText != "ctx")
+                contextEnabled = userText == "ctx on";
+            const PLCContextStats& cs = plcContext.getStats();
+            std::ostringstream info;
+            info.setf(std::ios::fixed);
+            info.precision(2);
+            info << "PLC 上下文：" << (contextEnabled ? "开启" : "关闭") << "，关注 " << cs.watched << " 个地址，上次发送 "
+                << cs.sent << " 行 / " << cs.bytes << " 字节（读取 " << cs.readMs << " ms，失败 " << cs.failed
+                << "），累计 " << cs.snapshots << " 次 / " << cs.totalBytes << " 字节\n\n";
+            printGBK(info.str());
+            continue;
+        }
+        if (userText == "early" || userText == "early on" || userText == "early off")
+        {
+            if (userText != "early")
+                earlyExec = userText == "early on";
+            const EarlyCommandStats& es = earlyCommands.getStats();
+            std::ostringstream info;
+            info.setf(std::ios::fixed);
+            info.precision(1);
+            info << "提前执行：" << (earlyExec ? "开启" : "关闭") << "，C: 指令 " << es.commands << " 条，提前执行 "
+                << es.early << " 条，累计节省 " << es.savedMs << " ms";
+            if (es.early > 0)
+                info << "（平均 " << es.savedMs / es.early << " ms）";
+            info << "\n\n";
+            printGBK(info.str());
+            continue;
+        }
+        if (userText == "budget" || userText.rfind("budget ", 0) == 0)
+        {
+            std::istringstream ss(userText.substr(6));
+            std::string what;
+            long long n = 0;
+            if (ss >> what)
+            {
+                if (!(ss >> n) || n <= 0 || (what != "steps" && what != "ms" && what != "tokens"))
+                {
+                    printGBK("用法：budget steps 4 / budget ms 30000 / budget tokens 32000\n\n");
+                    continue;
+                }
+                if (what == "steps") agentBudget.maxSteps = (int)n;
+                else if (what == "ms") agentBudget.maxMs = (int)n;
+                else agentBudget.maxTokens = n;
+            }
+            printGBK("多步预算：最多 " + std::to_string(agentBudget.maxSteps) + " 步，" + std::to_string(agentBudget.maxMs)
+                + " ms，" + std::to_string(agentBudget.maxTokens) + " tokens\n\n");
+            continue;
+        }
+        if (userText == "stats" || userText == "stats clear")
+        {
+            if (userText == "stats clear")
+                ai.clearLatencyStats();
+            printAILatency();
+            printGBK("\n");
+            continue;
+        }
+        if (userText == "provider")
+        {
+            std::string info = "主接口 " + ai.getProvider().name;
+            if (ai.hasControlProvider())
+                info += "，控制接口 " + ai.getControlProvider().name + "，已切换到主接口 "
+                    + std::to_string(ai.getFailoverCount()) + " 次";
+            if (!ai.getLastProviderName().empty())
+                info += "，上一次请求使用 " + ai.getLastProviderName();
+            printGBK(info + "\n\n");
+            continue;
+        }
+        if (userText.rfind("ctx ", 0) == 0)
+        {
+            int n = plcContext.load(userText.substr(4));
+            contextSeq = -1;
+            printGBK(n < 0 ? std::string("无法打开文件。\n\n") : "已加载 " + std::to_string(n) + " 个关注地址\n\n");
+            continue;
+        }
+        if (userText.rfind("tags ", 0) == 0)
+        {
+            int n = intents.loadTags(userText.substr(5));
+            printGBK(n < 0 ? std::string("无法打开文件。\n\n") : "已加载 " + std::to_string(n) + " 个标签\n\n");
+            continue;
+        }
+
+        std::string utf8User = GBKtoUTF8(userText);
+
+        // =====================================================
+        // 0) 快速通道：简单读写在本地识别并直接执行
+        // =====================================================
+        PLCIntent intent;
+        if (fastPath && intents.match(utf8User, intent))
+        {
+            auto fastStart = std::chrono::steady_clock::now();
+            std::vector<int32_t> values;
+            std::vector<bool> ok;
+            IntentMatcher::execute(plc, intent, values, ok);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fastStart).count();
+            intents.recordFast(ms);
+
+            printGBK("[本地] " + intent.describe() + "\n");
+            for (size_t i = 0; i < intent.addresses.size(); i++)
+            {
+                const char* what = intent.kind == PLCIntent::Read ? "读取" : "写入";
+                if (i < ok.size() && ok[i])
+                    printGBK("[PLC] " + intent.addresses[i] + " = " + std::to_string(values[i]) + "\n");
+                else
+                    printGBK("[PLC] " + intent.addresses[i] + " " + what + "失败\n");
+            }
+            std::ostringstream info;
+            info.setf(std::ios::fixed);
+            info.precision(2);
+            info << "（本地执行 " << ms << " ms，未调用 AI）\n\n";
+            printGBK(info.str());
+            continue;
+        }
+
         // =====================================================
         // 1) 生成 prompt
         // =====================================================
-        std::string utf8User = GBKtoUTF8(userText);
-        std::string aiText = ai.ask(utf8User,
-            u8"你是 fuduji-PLC 上位机助手，请按照以下格式输出：\n"
+        // 系统提示词固定不变（含地址格式说明），随对话变化的内容只出现在用户消息里，
+        // 这样请求前缀在多轮之间逐字节相同，可以命中服务端上下文缓存
+        static const std::string controlPrompt =
+            u8"你是 fuduji-PLC 上位机助手。读写 PLC 时调用 read_tags / write_tags 函数，"
+            u8"同一轮需要的所有地址放在一次调用里；拿到结果后按以下格式回答：\n"
             u8"W: <用户可读的中文文本，不含 JSON、代码块、特殊字符>\n"
-            u8"C: <PLC 指令：read I0.0 或 write Q0.0 1，没有则写 none>\n"
-        );
+            u8"C: none\n"
+            u8"无法调用函数时，在 C: 行写 PLC 指令：read I0.0 或 write Q0.0 1\n"
+            u8"用户消息末尾的 [PLC 当前值] 段列出关注地址的当前值（名称=值），[PLC 变化] 段只列出变化的值，"
+            u8"未列出的沿用之前的值；问题能用这些值回答时直接回答，不必再读取\n"
+            u8"可用地址：I/Q/M 位如 I0.0、Q0.1、M10.0；MB/MW/MD 如 MW100；"
+            u8"DB 如 DB1.DBX0.0、DB1.DBW4、DB1.DBD8；"
+            u8"Modbus 如 C12、DI3、HR10、HR10.3、HD10、IR4、IRD4\n";
+        // 函数调用的结果在同一轮内回传给 AI：先写后读合并成一次批量操作，
+        // 需要多次查询的问题（如 "2 号水箱为什么不进水"）可以连续多步，受 agentBudget 限制；
+        // 工具调用的回复不进入本地缓存
+        auto turnStart = std::chrono::steady_clock::now();
+        // 附加 PLC 当前值：一次批量读取，只带变化的值；历史起点变化（清空、淘汰、摘要）后重新发送完整快照
+        std::string request = utf8User;
+        if (contextEnabled && plcContext.size() > 0)
+        {
+            long long seq = ai.getHistoryFirstSeq();
+            std::string ctx = plcContext.snapshot(plc, seq != contextSeq);
+            contextSeq = seq;
+            if (!ctx.empty())
+                request += "\n\n" + ctx;
+        }
+        // 流式文本逐行交给 earlyCommands，C: 行结束即开始执行，不等回复结束
+        earlyCommands.begin(plc);
+        DeepSeekAI::TokenCallback onText = nullptr;
+        if (earlyExec)
+            onText = [this](const std::string& text) { earlyCommands.feed(text); };
+        int failoversBefore = ai.getFailoverCount();
+        auto stepStart = std::chrono::steady_clock::now();
+        AIReplyPtr pending = ai.askToolsAsync(request, controlPrompt, PLCTools::definitions(), onText);
+        std::string aiText = waitAIReply(pending);
+        double plcMs = 0;
+        int toolRounds = 0;
+        long long turnTokens = 0;
+        std::vector<AgentStep> steps;
+        std::string stopReason;   // 用完的预算，非空后不再执行函数调用
+        while (true)
+        {
+            AgentStep step;
+            step.modelMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+            if (pending->succeeded())
+            {
+                AIUsage u = ai.getLastUsage();
+                step.tokens = u.promptTokens + u.completionTokens;
+                turnTokens += step.tokens;
+            }
+            if (!pending->succeeded() || pending->getToolCalls().empty())
+            {
+                steps.push_back(step);
+                break;
+            }
+            std::vector<AIToolCall> calls = pending->getToolCalls();
+            step.calls = (int)calls.size();
+            if (!stopReason.empty())
+            {
+                // 已告知预算用完仍在调用：未回传结果的 tool_calls 会让后续请求被拒绝，清空本次对话
+                steps.push_back(step);
+                ai.clearHistory();
+                printGBK("[错误] " + stopReason + "预算用完后 AI 仍在调用函数，已清空对话历史\n");
+                break;
+            }
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - turnStart).count();
+            if (toolRounds >= agentBudget.maxSteps)
+                stopReason = "步数";
+            else if (elapsedMs >= agentBudget.maxMs)
+                stopReason = "耗时";
+            else if (turnTokens >= agentBudget.maxTokens)
+                stopReason = "token ";
+            if (!stopReason.empty())
+            {
+                // 不执行本步的调用，把预算用完作为结果交回，让模型用已有结果作答
+                for (auto& c : calls)
+                    c.result = u8"{\"error\":\"本轮预算已用完，不要再调用函数，直接根据已有结果回答\"}";
+                printGBK("[预算] " + stopReason + "预算用完，不再执行函数调用\n");
+            }
+            else
+            {
+                // 同一步的所有调用合并成一次批量写入和一次批量读取
+                earlyCommands.wait();   // 不与提前执行的指令同时使用 PLC
+                step.plc = PLCTools::execute(plc, calls);
+                plcMs += step.plc.plcMs;
+                toolRounds++;
+                for (auto& c : calls)
+                {
+                    printGBK("[PLC] ");
+                    printUTF8(c.name + " " + c.arguments + " -> " + c.result);
+                    printGBK("\n");
+                }
+            }
+            steps.push_back(step);
+            stepStart = std::chrono::steady_clock::now();
+            pending = ai.continueWithTools(calls, controlPrompt, PLCTools::definitions(), onText);
+            aiText = waitAIReply(pending);
+        }
+        auto aiDone = std::chrono::steady_clock::now();
+        earlyCommands.finish(aiDone);
+        if (ai.getFailoverCount() != failoversBefore)
+            printGBK("[接口] 控制接口不可用，本轮已改用 " + ai.getProvider().name + "\n");
+        // 提前执行的结果：指令在回复结束前已经发给 PLC，回复失败或被取消时也要告诉用户
+        auto printEarly = [this]() {
+            printGBK("执行控制（提前）：" + earlyCommands.command() + "\n");
+            const PLCIntent& it = earlyCommands.intent();
+            const std::string& addr = it.addresses[0];
+            bool ok = !earlyCommands.succeeded().empty() && earlyCommands.succeeded()[0];
+            if (it.kind == PLCIntent::Read)
+                printGBK(ok ? "[PLC] " + addr + " = " + std::to_string(earlyCommands.values()[0]) + "\n" : std::string("[PLC] 读取失败\n"));
+            else
+                printGBK(ok ? "[PLC] 写入成功：" + addr + " = " + std::to_string(it.value) + "\n" : std::string("[PLC] 写入失败\n"));
+        };
+        if (!pending->succeeded())
+        {
+            if (earlyCommands.started())
+                printEarly();
+            // 本轮附加的值可能没有进入历史，下一轮重新发送完整快照
+            plcContext.reset();
+            printUTF8(aiText);
+            printGBK("\n\n");
+            continue;
+        }
+        printAIUsage();
         // =====================================================
         // 2) 清洗 AI 输出（删除 BOM、隐藏字符、首尾空格）
         // =====================================================
@@ -344,15 +1118,68 @@ void Console::menuAIControlPLC()
             printGBK("\n");
         }
 
+        // 多步时逐步列出模型与 PLC 的耗时
+        if (steps.size() > 1)
+        {
+            std::ostringstream info;
+            info.setf(std::ios::fixed);
+            info.precision(1);
+            for (size_t i = 0; i < steps.size(); i++)
+            {
+                const AgentStep& st = steps[i];
+                info << "  步骤 " << i + 1 << "：AI " << st.modelMs << " ms，" << st.tokens << " tokens";
+                if (st.calls > 0)
+                    info << "，调用 " << st.calls << " 个（读 " << st.plc.reads << " / 写 " << st.plc.writes
+                        << " / 失败 " << st.plc.failed << "），PLC " << st.plc.plcMs << " ms";
+                info << "\n";
+            }
+            printGBK(info.str());
+        }
+
         // =====================================================
         // 4) 执行控制指令
         // =====================================================
+        if (earlyCommands.started())
+        {
+            printEarly();
+            if (lineC == earlyCommands.command())
+            {
+                auto turnEnd = std::chrono::steady_clock::now();
+                intents.recordAI(std::chrono::duration<double, std::milli>(turnEnd - turnStart).count());
+                const EarlyCommandStats& es = earlyCommands.getStats();
+                std::ostringstream info;
+                info.setf(std::ios::fixed);
+                info.precision(1);
+                info << "（AI " << std::chrono::duration<double, std::milli>(aiDone - turnStart).count()
+                    << " ms，PLC " << earlyCommands.plcMs() << " ms（回复结束前 " << es.lastLeadMs << " ms 开始），端到端 "
+                    << std::chrono::duration<double, std::milli>(turnEnd - turnStart).count()
+                    << " ms，节省 " << es.lastSavedMs << " ms）\n\n";
+                printGBK(info.str());
+                continue;
+            }
+            // 提前执行之后模型又给出了另一条指令：按原来的方式执行最后一条
+        }
         if (lineC.empty() || lineC == "none" || lineC == " none")
         {
-            printGBK("无控制指令。\n\n");
+            intents.recordAI(std::chrono::duration<double, std::milli>(aiDone - turnStart).count());
+            if (toolRounds == 0)
+            {
+                printGBK("无控制指令。\n\n");
+                continue;
+            }
+            std::ostringstream info;
+            info << "（函数调用 " << toolRounds << " 步，AI "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(aiDone - turnStart).count() - (long long)plcMs
+                << " ms，PLC " << plcMs << " ms，" << turnTokens << " tokens";
+            if (!stopReason.empty())
+                info << "，" << stopReason << "预算用完";
+            info << "）\n\n";
+            printGBK(info.str());
             continue;
         }
 
+        earlyCommands.recordLate();
+        auto plcStart = std::chrono::steady_clock::now();
         printGBK("执行控制：");
         printGBK(lineC + "\n");
 
@@ -395,5 +1222,14 @@ void Console::menuAIControlPLC()
         {
             printGBK("[错误] 无法识别控制命令\n\n");
         }
+
+        // 端到端耗时：AI 回复 + PLC 执行
+        auto turnEnd = std::chrono::steady_clock::now();
+        intents.recordAI(std::chrono::duration<double, std::milli>(turnEnd - turnStart).count());
+        std::ostringstream info;
+        info << "（AI " << std::chrono::duration_cast<std::chrono::milliseconds>(aiDone - turnStart).count()
+            << " ms，PLC " << std::chrono::duration_cast<std::chrono::microseconds>(turnEnd - plcStart).count() / 1000.0
+            << " ms，端到端 " << std::chrono::duration_cast<std::chrono::milliseconds>(turnEnd - turnStart).count() << " ms）\n\n";
+        printGBK(info.str());
     }
 }
@@ -2,6 +2,12 @@
 #include <string>
 #include "plcclient.h"
 #include "deepseek.h"
+#include "modbusserver.h"
+#include "mockserver.h"
+#include "intent.h"
+#include "plccontext.h"
+#include "earlycmd.h"
+#include "plctools.h"
 class Console
 {
 public:
@@ -19,8 +25,22 @@ private:
     void menuPLCManual();
     void menuAIDialog();
     void menuAIControlPLC();
+    void printAIUsage();   // ӡһỰۼƵ token /  / ãԼһĺʱֽ
+    void printAILatency(); // ӡʱĹٷλ
+    std::string waitAIReply(const AIReplyPtr& reply);  // ȴ첽ظڼ break0 ȡ
+    bool loadProviders(const std::string& file);       // ؽӿãѡӿ AI ʹõĽӿ
 private:
     PLCClient plc;
     DeepSeekAI ai;
+    ModbusServer mbServer;   //  Modbus վ mbsim ʱ
+    MockAIServer mockAI;     //  DeepSeek ӿAI Key  mock ʱ
+    IntentMatcher intents;   // AI ģʽ¼򵥶дָıʶ𣨱ǩֵ tags.txt
+    bool fastPath = true;
+    PLCContext plcContext;   // ӵ AI е PLC ǰֵעб context.txt
+    bool contextEnabled = true;
+    long long contextSeq = -1;   // ϴηͿʱʷ㣬仯·
+    EarlyCommandRunner earlyCommands;   // ʽظ C: нִУıص
+    bool earlyExec = true;
+    AgentBudget agentBudget;   // AI ģʽһڶಽõĲ / ʱ / token 
     bool hasAIKey = false;
 };
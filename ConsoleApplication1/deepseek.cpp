@@ -1,46 +1,816 @@
 ﻿#include "deepseek.h"
 #include <iostream>
 #include <sstream>
-#include <curl/curl.h>
+#include <memory>
+#include <cstring>
+#include <chrono>
 
-// -------- cURL 写入回调（保持原始 UTF-8） --------
-static size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* response) {
-    size_t totalSize = size * nmemb;
-    response->append((char*)contents, totalSize);  // 保留 UTF-8 原样
-    return totalSize;
+// -------- SSE 流式解析 --------
+// curl 的数据块可能在任意位置截断（包括 UTF-8 多字节字符中间），
+// 这里按行缓存，完整的 "data:" 行再解析；交给回调的文本只在字符边界处切分
+struct StreamState {
+    std::string line;          // 尚不完整的一行
+    std::string raw;           // 非 SSE 应答（如错误 JSON）的原始内容
+    std::string reply;         // 拼接好的完整回复
+    std::string pending;       // 尚未输出的不完整 UTF-8 尾部
+    std::string error;         // 流中返回的错误信息
+    AIResponseFields fields;   // 逐行复用的字段提取结果
+    AIResponseFields usage;    // 最后一个数据块中的 usage（只用到 usage 字段）
+    std::vector<AIToolCall> toolCalls;  // 按 index 拼接的工具调用
+    bool isStream = false;     // 是否收到过 data: 行
+    bool done = false;         // 是否收到 [DONE]
+    double firstTokenMs = 0;   // 第一段文本或工具调用到达的时间（从传输开始算起）
+    double parseMs = 0;        // 解析耗时（不含回调）
+    double printMs = 0;        // onToken 回调耗时
+    DeepSeekAI::TokenCallback onToken;
+};
+
+// 返回 s 中以完整 UTF-8 字符结尾的最长前缀长度
+static size_t utf8CompleteLength(const std::string& s) {
+    size_t n = s.size();
+    for (size_t i = 1; i <= 4 && i <= n; i++) {
+        unsigned char c = s[n - i];
+        if ((c & 0xC0) == 0x80) continue;  // 续字节，继续向前找首字节
+        size_t need = c < 0x80 ? 1 : (c >> 5) == 0x06 ? 2 : (c >> 4) == 0x0E ? 3 : (c >> 3) == 0x1E ? 4 : 1;
+        return need > i ? n - i : n;
+    }
+    return n;
+}
+
+static void emitText(StreamState* st, const std::string& text) {
+    st->reply += text;
+    if (!st->onToken) return;
+    st->pending += text;
+    size_t n = utf8CompleteLength(st->pending);
+    if (n == 0) return;
+    auto t0 = std::chrono::steady_clock::now();
+    st->onToken(st->pending.substr(0, n));
+    st->printMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    st->pending.erase(0, n);
+}
+
+static void copyUsage(const AIResponseFields& from, AIResponseFields& to) {
+    to.hasUsage = true;
+    to.promptTokens = from.promptTokens;
+    to.completionTokens = from.completionTokens;
+    to.cacheHitTokens = from.cacheHitTokens;
+    to.cacheMissTokens = from.cacheMissTokens;
+}
+
+static void handleLine(StreamState* st, std::string& line) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty() || line[0] == ':') return;     // 事件分隔 / 注释（keep-alive）
+    if (line.compare(0, 5, "data:") != 0) return;
+
+    size_t p = 5;
+    if (p < line.size() && line[p] == ' ') p++;
+    st->isStream = true;
+    if (line.compare(p, std::string::npos, "[DONE]") == 0) {
+        st->done = true;
+        return;
+    }
+
+    // 直接在行缓冲区上提取需要的字段，不建立 DOM
+    AIResponseFields& f = st->fields;
+    if (!scanResponse(line.data() + p, line.size() - p, f))
+        return;
+    if (f.hasError) {
+        st->error = f.errorMessage;
+        return;
+    }
+    if (f.hasUsage)
+        copyUsage(f, st->usage);
+    if (f.hasContent)
+        emitText(st, f.content);
+
+    // 工具调用分多个数据块到达：首块带 id 和函数名，之后只追加参数片段
+    for (int i = 0; i < f.toolCount; i++) {
+        const AIToolDelta& d = f.toolCalls[i];
+        size_t index = d.index >= 0 ? (size_t)d.index : 0;
+        if (index >= st->toolCalls.size()) st->toolCalls.resize(index + 1);
+        AIToolCall& tc = st->toolCalls[index];
+        if (!d.id.empty()) tc.id = d.id;
+        tc.name += d.name;
+        tc.arguments += d.arguments;
+    }
+}
+
+// -------- 应答数据（保持原始 UTF-8） --------
+static void feedStream(StreamState* st, const char* contents, size_t totalSize) {
+    if (!st->isStream)
+        st->raw.append(contents, totalSize);  // 保留 UTF-8 原样，非流式应答时使用
+
+    const char* p = contents;
+    const char* end = contents + totalSize;
+    while (p < end) {
+        const char* nl = (const char*)memchr(p, '\n', end - p);
+        if (!nl) {
+            st->line.append(p, end - p);
+            break;
+        }
+        st->line.append(p, nl - p);
+        handleLine(st, st->line);
+        st->line.clear();
+        p = nl + 1;
+    }
+}
+
+// -------- JSON 编码 --------
+// 按 JSON 规则转义字符串并追加到 out；UTF-8 多字节字符原样写入
+static void appendJsonString(std::string& out, const std::string& s) {
+    static const char hexDigits[] = "0123456789abcdef";
+    out += '"';
+    size_t run = 0;   // 无需转义的连续片段起点
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out.append(s, run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        default:
+            out += "\\u00";
+            out += hexDigits[c >> 4];
+            out += hexDigits[c & 0xF];
+        }
+    }
+    out.append(s, run, std::string::npos);
+    out += '"';
+}
+
+static void appendMessageJson(std::string& out, const std::string& role, const std::string& content,
+    const std::string& toolCalls = "", const std::string& toolCallId = "") {
+    out += "{\"role\":";
+    appendJsonString(out, role);
+    if (!toolCallId.empty()) {
+        out += ",\"tool_call_id\":";
+        appendJsonString(out, toolCallId);
+    }
+    out += ",\"content\":";
+    appendJsonString(out, content);
+    if (!toolCalls.empty()) {
+        out += ",\"tool_calls\":";
+        out += toolCalls;
+    }
+    out += '}';
+}
+
+// 编码 assistant 消息中的 tool_calls 数组
+static std::string encodeToolCalls(const std::vector<AIToolCall>& calls) {
+    std::string out = "[";
+    for (size_t i = 0; i < calls.size(); i++) {
+        if (i) out += ',';
+        out += "{\"id\":";
+        appendJsonString(out, calls[i].id);
+        out += ",\"type\":\"function\",\"function\":{\"name\":";
+        appendJsonString(out, calls[i].name);
+        out += ",\"arguments\":";
+        appendJsonString(out, calls[i].arguments);
+        out += "}}";
+    }
+    out += ']';
+    return out;
+}
+
+// -------- 对话历史环形缓冲区 --------
+// 请求头：本地服务没有 Key 时不发送 Authorization
+static std::vector<std::string> requestHeaders(const AIProvider& p, bool stream) {
+    std::vector<std::string> h = {
+        "Content-Type: application/json",
+        stream ? "Accept: text/event-stream, application/json" : "Accept: application/json",
+    };
+    if (!p.apiKey.empty())
+        h.push_back("Authorization: Bearer " + p.apiKey);
+    return h;
+}
+
+// 请求体开头：{"model":"...",
+static void appendModel(std::string& out, const AIProvider& p) {
+    out += "{\"model\":";
+    appendJsonString(out, p.model);
+    out += ',';
+}
+
+MessageRing::MessageRing(int capacity) : slots(capacity) {
+}
+
+void MessageRing::push(const std::string& role, const std::string& content, int tokens,
+    const std::string& toolCalls, const std::string& toolCallId) {
+    if (count == (int)slots.size())
+        popFront();
+    Message& m = slots[(head + count) % slots.size()];
+    m.role = role;
+    m.content = content;   // 复用槽位中字符串已有的容量
+    m.tokens = tokens;
+    m.toolCalls = toolCalls;
+    m.toolCallId = toolCallId;
+    m.encoded.clear();
+    appendMessageJson(m.encoded, role, content, toolCalls, toolCallId);
+    totalTokens += tokens;
+    count++;
+}
+
+void MessageRing::popFront() {
+    if (count == 0) return;
+    totalTokens -= slots[head].tokens;
+    slots[head].content.clear();
+    slots[head].encoded.clear();
+    head = (head + 1) % slots.size();
+    count--;
+    popped++;
+}
+
+void MessageRing::clear() {
+    while (count > 0) popFront();
+    head = 0;
+}
+
+const Message& MessageRing::at(int i) const {
+    return slots[(head + i) % slots.size()];
+}
+
+// -------- 异步回复句柄 --------
+bool AIReply::wait(int timeoutMs) {
+    std::unique_lock<std::mutex> lk(m);
+    if (timeoutMs < 0) {
+        cv.wait(lk, [this] { return ready.load(); });
+        return true;
+    }
+    return cv.wait_for(lk, std::chrono::milliseconds(timeoutMs), [this] { return ready.load(); });
+}
+
+bool AIReply::isReady() const {
+    return ready;
+}
+
+void AIReply::cancel() {
+    AITransferPtr t;
+    {
+        std::lock_guard<std::mutex> lk(m);
+        t = transfer;
+    }
+    if (t) t->cancel();
+}
+
+std::string AIReply::get() {
+    wait();
+    return text;
+}
+
+bool AIReply::succeeded() const {
+    return ready && ok;
+}
+
+bool AIReply::isCancelled() const {
+    return ready && cancelled;
+}
+
+bool AIReply::isTimedOut() const {
+    return ready && timedOut;
+}
+
+const std::vector<AIToolCall>& AIReply::getToolCalls() const {
+    return toolCalls;
+}
+
+void AIReply::complete(const std::string& result, bool success) {
+    {
+        std::lock_guard<std::mutex> lk(m);
+        text = result;
+        ok = success;
+        ready = true;
+    }
+    cv.notify_all();
 }
 
 DeepSeekAI::DeepSeekAI() {
-    curl_global_init(CURL_GLOBAL_DEFAULT);
 }
 
 DeepSeekAI::~DeepSeekAI() {
-    curl_global_cleanup();
 }
 
 void DeepSeekAI::setAPIKey(const std::string& key) {
-    apiKey = key;
+    std::lock_guard<std::mutex> lk(mtx);
+    provider.apiKey = key;
+}
+
+void DeepSeekAI::setEndpoint(const std::string& url) {
+    std::lock_guard<std::mutex> lk(mtx);
+    provider.endpoint = url;
+}
+
+std::string DeepSeekAI::getEndpoint() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return provider.endpoint;
+}
+
+void DeepSeekAI::setProvider(const AIProvider& p) {
+    std::lock_guard<std::mutex> lk(mtx);
+    provider = p;
+}
+
+AIProvider DeepSeekAI::getProvider() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return provider;
+}
+
+void DeepSeekAI::setControlProvider(const AIProvider& p, int cooldownMs) {
+    std::lock_guard<std::mutex> lk(mtx);
+    control = p;
+    hasControl = true;
+    controlCooldownMs = cooldownMs;
+    controlDownUntil = std::chrono::steady_clock::time_point();
+}
+
+void DeepSeekAI::clearControlProvider() {
+    std::lock_guard<std::mutex> lk(mtx);
+    hasControl = false;
+}
+
+bool DeepSeekAI::hasControlProvider() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return hasControl;
+}
+
+AIProvider DeepSeekAI::getControlProvider() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return control;
+}
+
+std::string DeepSeekAI::getLastProviderName() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return lastProvider;
+}
+
+int DeepSeekAI::getFailoverCount() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return failovers;
+}
+
+void DeepSeekAI::setRetryPolicy(int retries, int delayMs) {
+    std::lock_guard<std::mutex> lk(mtx);
+    this->retries = retries > 0 ? retries : 0;
+    retryDelayMs = delayMs > 0 ? delayMs : 500;
+}
+
+int DeepSeekAI::getRetries() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return retries;
+}
+
+int DeepSeekAI::getRetryDelayMs() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return retryDelayMs;
+}
+
+void DeepSeekAI::setHedging(bool on) {
+    std::lock_guard<std::mutex> lk(mtx);
+    hedging = on;
+}
+
+bool DeepSeekAI::isHedging() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return hedging;
+}
+
+void DeepSeekAI::applyRetryPolicy(AITransfer& t, int maxRetries, bool hedge) {
+    t.retries = maxRetries < retries ? maxRetries : retries;
+    t.retryDelayMs = retryDelayMs;
+    // 对冲阈值：收到第一段内容的 p95。流式应答的响应头很快就到，按首 token 计；没有流式样本时按首字节计
+    // 样本太少时不对冲
+    t.hedgeAfterMs = 0;
+    AILatencyStats::Metric m = latency.count(AILatencyStats::FirstToken) >= 20
+        ? AILatencyStats::FirstToken : AILatencyStats::FirstByte;
+    if (hedge && hedging && latency.count(m) >= 20)
+        t.hedgeAfterMs = (int)latency.percentile(m, 95) + 1;
+}
+
+AIRequestTiming DeepSeekAI::getLastTiming() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return lastTiming;
+}
+
+AILatencyStats DeepSeekAI::getLatencyStats() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return latency;
+}
+
+void DeepSeekAI::clearLatencyStats() {
+    std::lock_guard<std::mutex> lk(mtx);
+    latency.clear();
+}
+
+void DeepSeekAI::recordTiming(const AITransfer& t, bool ok, const AIResponseFields* usage,
+    double firstTokenMs, double parseMs, double printMs, bool last) {
+    AIRequestTiming r;
+    r.ok = ok;
+    r.streamed = firstTokenMs > 0;
+    r.queueMs = t.queueMs;
+    r.dnsMs = t.nameLookupMs;
+    r.connectMs = t.connectMs;
+    r.tlsMs = t.appConnectMs;
+    r.firstByteMs = t.firstByteMs;
+    r.firstTokenMs = firstTokenMs;
+    r.totalMs = t.totalMs;
+    r.parseMs = parseMs;
+    r.printMs = printMs;
+    r.attempts = t.attempts > 0 ? t.attempts : 1;
+    r.hedged = t.hedged;
+    r.hedgeWon = t.hedgeWon;
+    r.retryWaitMs = t.retryWaitMs;
+    if (usage && usage->hasUsage) {
+        r.promptTokens = usage->promptTokens;
+        r.completionTokens = usage->completionTokens;
+    }
+    latency.record(r);
+    if (last)
+        lastTiming = r;
+}
+
+double DeepSeekAI::getLastFirstByteMs() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return lastFirstByteMs;
+}
+
+bool DeepSeekAI::lastConnectionReused() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return lastReused;
 }
 
-void DeepSeekAI::addMessage(const std::string& role, const std::string& content) {
-    history.push_back({ role, content });
-    if (history.size() > 40) history.erase(history.begin());
+size_t DeepSeekAI::getLastRequestBytes() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return lastRequestBytes;
+}
+
+double DeepSeekAI::getLastTotalMs() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return lastTotalMs;
+}
+
+AIUsage DeepSeekAI::getLastUsage() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return lastUsage;
+}
+
+AIUsage DeepSeekAI::getSessionUsage() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return sessionUsage;
+}
+
+void DeepSeekAI::setPricing(double hitPerM, double missPerM, double outputPerM) {
+    std::lock_guard<std::mutex> lk(mtx);
+    priceHit = hitPerM;
+    priceMiss = missPerM;
+    priceOutput = outputPerM;
+}
+
+void DeepSeekAI::recordUsage(const AIResponseFields& usage, bool last) {
+    if (!usage.hasUsage) return;
+    AIUsage u;
+    u.requests = 1;
+    u.promptTokens = usage.promptTokens;
+    u.completionTokens = usage.completionTokens;
+    u.cacheHitTokens = usage.cacheHitTokens;
+    u.cacheMissTokens = usage.cacheMissTokens >= 0 ? usage.cacheMissTokens : u.promptTokens - u.cacheHitTokens;
+    u.cost = (u.cacheHitTokens * priceHit + u.cacheMissTokens * priceMiss
+        + u.completionTokens * priceOutput) / 1e6;
+
+    if (last) lastUsage = u;
+    sessionUsage.requests++;
+    sessionUsage.promptTokens += u.promptTokens;
+    sessionUsage.completionTokens += u.completionTokens;
+    sessionUsage.cacheHitTokens += u.cacheHitTokens;
+    sessionUsage.cacheMissTokens += u.cacheMissTokens;
+    sessionUsage.cost += u.cost;
+}
+
+void DeepSeekAI::enableCache(const std::string& file, int capacity, int ttlSec) {
+    std::lock_guard<std::mutex> lk(mtx);
+    cacheTtl = ttlSec;
+    cacheEnabled = true;
+    if (file.empty() || !cache.open(file, capacity))
+        cache.close();
+}
+
+void DeepSeekAI::disableCache() {
+    std::lock_guard<std::mutex> lk(mtx);
+    cacheEnabled = false;
+    cache.close();
+}
+
+bool DeepSeekAI::isCacheEnabled() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return cacheEnabled;
+}
+
+AICacheStats DeepSeekAI::getCacheStats() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return cache.getStats();
+}
+
+bool DeepSeekAI::lastFromCache() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return lastCached;
+}
+
+// 同一个问题在不同上下文中含义可能不同，所以键里带上最近一轮（两条）历史消息
+uint64_t DeepSeekAI::cacheKey(const std::string& userMessage, const std::string& systemPrompt) const {
+    uint64_t h = AICache::hash(systemPrompt);
+    h = AICache::hash(AICache::normalize(userMessage), h);
+    for (int i = history.size() > 2 ? history.size() - 2 : 0; i < history.size(); i++) {
+        h = AICache::hash(history.at(i).role, h);
+        h = AICache::hash(history.at(i).content, h);
+    }
+    return h;
+}
+
+void DeepSeekAI::setTokenBudget(int tokens) {
+    std::lock_guard<std::mutex> lk(mtx);
+    tokenBudget = tokens;
+}
+
+int DeepSeekAI::getTokenBudget() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return tokenBudget;
+}
+
+int DeepSeekAI::getHistoryTokens() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return history.tokens() + summaryTokens;
+}
+
+long long DeepSeekAI::getHistoryFirstSeq() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return history.firstSeq();
+}
+
+int DeepSeekAI::estimateTokens(const std::string& utf8) {
+    int ascii = 0, wide = 0;
+    for (unsigned char c : utf8) {
+        if (c < 0x80) ascii++;
+        else if ((c & 0xC0) != 0x80) wide++;   // 只数首字节
+    }
+    return (ascii * 3 + wide * 6) / 10 + 4;    // 每条消息另加角色等固定开销
+}
+
+// 历史必须从一轮的 user 消息开始：丢弃开头不完整的一轮；没有 user 消息时清空，
+// 不留下失去 tool_calls 的 tool 消息（否则下一次请求会被服务端拒绝）
+static void dropPartialTurn(MessageRing& history)
+{
+    int first = 0;
+    while (first < history.size() && history.at(first).role != "user")
+        first++;
+    if (first == history.size())
+        history.clear();
+    else
+        for (int i = 0; i < first; i++)
+            history.popFront();
+}
+
+void DeepSeekAI::addMessage(const std::string& role, const std::string& content,
+    const std::string& toolCalls, const std::string& toolCallId) {
+    int before = history.size();
+    int tokens = estimateTokens(content) + estimateTokens(toolCalls) - 4;
+    history.push(role, content, tokens, toolCalls, toolCallId);
+    if (log.isOpen()) {
+        AILogRecord r;
+        r.role = role;
+        r.content = content;
+        r.toolCalls = toolCalls;
+        r.toolCallId = toolCallId;
+        r.tokens = tokens;
+        log.append(r);
+    }
+    // 超出预算时一次淘汰到预算的 3/4，而不是每轮只淘汰一条：
+    // 淘汰会改变请求前缀，使服务端上下文缓存失效，成批淘汰让前缀在多轮之间保持不变
+    // 按整轮淘汰（user 及其后的 assistant / tool 消息），不从一轮中间截断
+    if (history.tokens() > tokenBudget) {
+        while (history.tokens() > tokenBudget * 3 / 4) {
+            int next = 1;
+            while (next < history.size() && history.at(next).role != "user")
+                next++;
+            if (next >= history.size())
+                break;
+            for (int i = 0; i < next; i++)
+                history.popFront();
+        }
+        // 只剩一轮仍超出预算，且是未完成的工具调用序列：整轮清掉，不保留其中一部分
+        const Message& last = history.at(history.size() - 1);
+        bool finished = last.role == "user" || (last.role == "assistant" && last.toolCalls.empty());
+        if (history.tokens() > tokenBudget && !finished)
+            history.clear();
+    }
+    // 环形缓冲区满时 push 会挤掉最旧的一条，可能留下半轮
+    dropPartialTurn(history);
+
+    // 没有淘汰时只把新消息追加到已编码的前缀
+    if (history.size() != before + 1)
+        prefixValid = false;
+    else if (prefixValid) {
+        if (prefix.back() != '[') prefix += ',';
+        prefix += history.at(history.size() - 1).encoded;
+    }
+    // 一轮对话结束时检查是否需要摘要（不在工具调用中途切分）
+    if (role == "assistant" && toolCalls.empty())
+        maybeSummarize();
+}
+
+// -------- 历史摘要 --------
+static const char* const summarizePrompt =
+    u8"你负责压缩 PLC 上位机助手的对话历史。把给出的已有摘要和对话合并成一段新的中文摘要，"
+    u8"保留：用户的目标与偏好、涉及的 PLC 地址及其最后已知的值、已执行的写操作、未完成的事项。"
+    u8"不要编造，不要输出格式说明，不超过 300 字。";
+
+void DeepSeekAI::setSummarize(bool enabled, int thresholdTokens) {
+    std::lock_guard<std::mutex> lk(mtx);
+    summarizeEnabled = enabled;
+    summarizeThreshold = thresholdTokens;
+}
+
+std::string DeepSeekAI::getSummary() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return summary;
+}
+
+int DeepSeekAI::getSummaryCount() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return summaryCount;
+}
+
+void DeepSeekAI::maybeSummarize() {
+    int threshold = summarizeThreshold > 0 ? summarizeThreshold : tokenBudget / 2;
+    if (!summarizeEnabled || summaryTransfer || !provider.usable() || history.tokens() <= threshold)
+        return;
+
+    // 从最旧的消息开始，摘要到剩余不超过阈值的一半，并且在 user 消息处切分，
+    // 保证剩下的历史以 user 开头、工具调用与结果不被拆开
+    int cut = 0;
+    int remaining = history.tokens();
+    for (int i = 0; i < history.size(); i++) {
+        if (i > 0 && history.at(i).role == "user") {
+            cut = i;
+            if (remaining <= threshold / 2) break;
+        }
+        remaining -= history.at(i).tokens;
+    }
+    if (cut < 2) return;
+
+    std::string transcript;
+    if (!summary.empty())
+        transcript += u8"已有摘要：\n" + summary + u8"\n\n对话：\n";
+    for (int i = 0; i < cut; i++) {
+        const Message& m = history.at(i);
+        if (m.role == "user") transcript += u8"用户：";
+        else if (m.role == "tool") transcript += u8"工具结果：";
+        else transcript += u8"助手：";
+        transcript += m.content;
+        if (!m.toolCalls.empty()) transcript += u8"（调用工具 " + m.toolCalls + u8"）";
+        transcript += '\n';
+    }
+
+    AITransferPtr t = std::make_shared<AITransfer>();
+    t->url = provider.endpoint;
+    t->headers = requestHeaders(provider, false);
+    t->connectTimeoutMs = provider.connectTimeoutMs;
+    appendModel(t->body, provider);
+    t->body += "\"messages\":[";
+    appendMessageJson(t->body, "system", summarizePrompt);
+    t->body += ',';
+    appendMessageJson(t->body, "user", transcript);
+    t->body += "],\"stream\":false,\"max_tokens\":512,\"temperature\":0.3}";
+    t->timeoutMs = 60000;
+    applyRetryPolicy(*t, 1, false);   // 后台摘要失败只是推迟，重试一次即可
+    auto body = std::make_shared<std::string>();
+    t->onData = [body](const char* data, size_t len) { body->append(data, len); };
+    long long endSeq = history.firstSeq() + cut;
+    t->onDone = [this, body, endSeq](AITransfer& done) { finishSummary(done, *body, endSeq); };
+    summaryTransfer = t;
+    transport.submit(t);
+}
+
+// 在事件循环线程中调用：用摘要替换序号 endSeq 之前的消息
+void DeepSeekAI::finishSummary(AITransfer& t, const std::string& body, long long endSeq) {
+    std::lock_guard<std::mutex> lk(mtx);
+    summaryTransfer.reset();
+    AIResponseFields f;
+    auto t0 = std::chrono::steady_clock::now();
+    bool ok = !t.cancelled && t.curlCode == 0 && scanResponse(body.data(), body.size(), f) && !f.hasError
+        && !f.content.empty();
+    double parseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    recordTiming(t, ok, ok ? &f : nullptr, 0, parseMs, 0, false);
+    if (!ok)
+        return;
+    recordUsage(f, false);
+    // 期间被清空或已经另有摘要：结果作废
+    if (history.firstSeq() > endSeq || history.size() == 0)
+        return;
+
+    while (history.size() > 0 && history.firstSeq() < endSeq)
+        history.popFront();
+    dropPartialTurn(history);
+    summary = f.content;
+    summaryTokens = estimateTokens(summary);
+    summaryCount++;
+    prefixValid = false;
+}
+
+void DeepSeekAI::rebuildPrefix(const std::string& model, const std::string& systemPrompt, const std::string& tools) {
+    prefix.clear();
+    prefix += "{\"model\":";
+    appendJsonString(prefix, model);
+    prefix += ',';
+    if (!tools.empty()) {
+        prefix += "\"tools\":";
+        prefix += tools;
+        prefix += ',';
+    }
+    prefix += "\"messages\":[";
+    if (!systemPrompt.empty())
+        appendMessageJson(prefix, "system", systemPrompt);
+    if (!summary.empty()) {
+        if (prefix.back() != '[') prefix += ',';
+        appendMessageJson(prefix, "system", u8"此前对话的摘要：\n" + summary);
+    }
+    for (int i = 0; i < history.size(); i++) {
+        if (prefix.back() != '[') prefix += ',';
+        prefix += history.at(i).encoded;
+    }
+    prefixSystem = systemPrompt;
+    prefixTools = tools;
+    prefixModel = model;
+    prefixValid = true;
 }
 
 void DeepSeekAI::showHistory() {
+    std::lock_guard<std::mutex> lk(mtx);
     std::cout << "\n=== 对话历史 ===\n";
-    int i = 0;
-    for (auto& msg : history) {
-        std::cout << msg.role << "(" << i++ << "): " << msg.content << "\n";
+    if (!summary.empty())
+        std::cout << "摘要(~" << summaryTokens << " tokens): " << summary << "\n";
+    for (int i = 0; i < history.size(); i++) {
+        const Message& msg = history.at(i);
+        std::cout << msg.role << "(" << i << ", ~" << msg.tokens << " tokens): " << msg.content << "\n";
     }
+    std::cout << "共 ~" << history.tokens() + summaryTokens << " / " << tokenBudget << " tokens\n";
     std::cout << "================\n";
 }
 
 void DeepSeekAI::clearHistory() {
+    std::lock_guard<std::mutex> lk(mtx);
     history.clear();
+    summary.clear();
+    summaryTokens = 0;
+    if (summaryTransfer) summaryTransfer->cancel();
+    prefixValid = false;
+    if (log.isOpen())
+        log.appendBoundary();
+}
+
+int DeepSeekAI::openLog(const std::string& file) {
+    std::lock_guard<std::mutex> lk(mtx);
+    // 日志中保留预算的 4 倍，恢复时只读取尾部预算的 3/4（与淘汰后的历史长度一致）
+    if (!log.open(file, tokenBudget * 4))
+        return -1;
+    std::vector<AILogRecord> records = log.tail(tokenBudget * 3 / 4);
+    history.clear();
+    summary.clear();
+    summaryTokens = 0;
+    for (auto& r : records)
+        history.push(r.role, r.content, r.tokens, r.toolCalls, r.toolCallId);
+    dropPartialTurn(history);
+    prefixValid = false;
+    return history.size();
+}
+
+void DeepSeekAI::closeLog() {
+    std::lock_guard<std::mutex> lk(mtx);
+    log.close();
+}
+
+bool DeepSeekAI::isLogOpen() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return log.isOpen();
+}
+
+AILogStats DeepSeekAI::getLogStats() const {
+    std::lock_guard<std::mutex> lk(mtx);
+    return log.getStats();
+}
+
+bool DeepSeekAI::compactLog() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return log.compact();
 }
 
 std::string DeepSeekAI::ask(const std::string& userMessage) {
+    return ask(userMessage, TokenCallback());
+}
+std::string DeepSeekAI::ask(const std::string& userMessage, TokenCallback onToken) {
     // 使用UTF-8编码的中文提示词
     std::string prompt =
         /*u8"你是一个专业的PLC控制助手。"
@@ -51,102 +821,365 @@ std::string DeepSeekAI::ask(const std::string& userMessage) {
         u8"用户：讲个笑话 回复：我专注于PLC技术问题，请咨询相关工控内容。";
         */
         "";
-    return callAPI(userMessage, prompt);
+    return askAsync(userMessage, prompt, onToken)->get();
 }
 std::string DeepSeekAI::ask(const std::string& userMessage, const std::string& systemPrompt) {
-    return callAPI(userMessage, systemPrompt);
+    return askAsync(userMessage, systemPrompt, TokenCallback())->get();
+}
+std::string DeepSeekAI::ask(const std::string& userMessage, const std::string& systemPrompt,
+    TokenCallback onToken) {
+    return askAsync(userMessage, systemPrompt, onToken)->get();
 }
 
-std::string DeepSeekAI::callAPI(const std::string& userMessage, const std::string& systemPrompt) {
-    if (apiKey.empty())
-        return "api未绑定";
+AIReplyPtr DeepSeekAI::askAsync(const std::string& userMessage, const std::string& systemPrompt,
+    TokenCallback onToken, ProgressCallback onProgress, int timeoutMs) {
+    uint64_t key = 0;
+    std::string cached;
+    bool hit = false;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        lastCached = false;
 
-    std::string response;
+        // -------- 本地缓存 --------
+        if (cacheEnabled && provider.usable()) {
+            key = cacheKey(userMessage, systemPrompt);
+            if (cache.get(key, cached)) {
+                hit = true;
+                lastUsage = AIUsage();
+                lastCached = true;
+                lastRequestBytes = 0;
+                lastFirstByteMs = lastTotalMs = 0;
+                addMessage("user", userMessage);
+                addMessage("assistant", cached);
+            }
+        }
+    }
+    // 回调在锁外调用：回调中可以再调用 DeepSeekAI 的方法
+    if (hit) {
+        AIReplyPtr reply = std::make_shared<AIReply>();
+        if (onToken) onToken(cached);
+        reply->complete(cached, true);
+        return reply;
+    }
+    return sendAsync(&userMessage, systemPrompt, "", key, onToken, onProgress, timeoutMs);
+}
 
-    CURL* curl = curl_easy_init();
-    if (!curl)
-        return "CURL 初始化失败.";
+AIReplyPtr DeepSeekAI::askToolsAsync(const std::string& userMessage, const std::string& systemPrompt,
+    const std::string& tools, TokenCallback onToken, int timeoutMs) {
+    return sendAsync(&userMessage, systemPrompt, tools, 0, onToken, nullptr, timeoutMs);
+}
 
-    curl_easy_setopt(curl, CURLOPT_URL, "https://api.deepseek.com/v1/chat/completions");
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+AIReplyPtr DeepSeekAI::continueWithTools(const std::vector<AIToolCall>& calls, const std::string& systemPrompt,
+    const std::string& tools, TokenCallback onToken, int timeoutMs) {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        for (auto& c : calls)
+            addMessage("tool", c.result, "", c.id);
+    }
+    return sendAsync(nullptr, systemPrompt, tools, 0, onToken, nullptr, timeoutMs);
+}
+
+AIReplyPtr DeepSeekAI::sendAsync(const std::string* userMessage, const std::string& systemPrompt,
+    const std::string& tools, uint64_t key, TokenCallback onToken, ProgressCallback onProgress, int timeoutMs) {
+    AIReplyPtr reply = std::make_shared<AIReply>();
+    std::lock_guard<std::mutex> lk(mtx);
+    // 带工具定义的请求来自 AI 控制，延迟敏感：控制接口可用且不在冷却期内时优先使用
+    bool useControl = !tools.empty() && hasControl && control.usable()
+        && std::chrono::steady_clock::now() >= controlDownUntil;
+    if (!useControl && !provider.usable()) {
+        reply->complete("api未绑定", false);
+        return reply;
+    }
+
+    lastUsage = AIUsage();
+    lastCached = false;
+    submitLocked(reply, useControl, userMessage != nullptr, userMessage ? *userMessage : std::string(),
+        systemPrompt, tools, key, onToken, onProgress, timeoutMs);
+    return reply;
+}
+
+void DeepSeekAI::submitLocked(const AIReplyPtr& reply, bool useControl, bool hasUser, const std::string& user,
+    const std::string& systemPrompt, const std::string& tools, uint64_t key,
+    TokenCallback onToken, ProgressCallback onProgress, int timeoutMs) {
+    const AIProvider& p = useControl ? control : provider;
+    lastProvider = p.name;
+    // 不支持函数调用的接口不带工具定义，模型按系统提示词中的文本格式回答
+    std::string sendTools = p.tools ? tools : std::string();
 
     // -------- 构造 JSON 请求 --------
-    Json::Value root;
-    Json::Value messages(Json::arrayValue);
+    // 请求布局：model、工具定义、系统提示词、历史、本次用户消息，随调用变化的参数都放在 messages 之后，
+    // 保证同一会话的请求前缀逐字节相同，可以命中服务端上下文缓存
+    // 前缀（工具 + 系统提示词 + 历史）已编码好，这里只追加本次用户消息和固定参数
+    if (!prefixValid || systemPrompt != prefixSystem || sendTools != prefixTools || p.model != prefixModel)
+        rebuildPrefix(p.model, systemPrompt, sendTools);
 
-    if (!systemPrompt.empty()) {
-        Json::Value sm;
-        sm["role"] = "system";
-        sm["content"] = systemPrompt;
-        messages.append(sm);
+    requestBuf.assign(prefix);
+    if (hasUser) {
+        if (requestBuf.back() != '[') requestBuf += ',';
+        appendMessageJson(requestBuf, "user", user);
     }
+    if (p.streaming)
+        requestBuf += "],\"stream\":true,\"stream_options\":{\"include_usage\":true},"
+            "\"max_tokens\":2048,\"temperature\":0.7}";
+    else
+        requestBuf += "],\"stream\":false,\"max_tokens\":2048,\"temperature\":0.7}";
+    lastRequestBytes = requestBuf.size();
 
-    for (auto& msg : history) {
-        Json::Value m;
-        m["role"] = msg.role;
-        m["content"] = msg.content;
-        messages.append(m);
-    }
+    // -------- 提交到后台事件循环 --------
+    // 应答在事件循环线程中解析；完成时在锁内写入历史、用量和缓存
+    auto stream = std::make_shared<StreamState>();
+    stream->onToken = onToken;
 
+    AITransferPtr t = std::make_shared<AITransfer>();
+    t->url = p.endpoint;
+    t->headers = requestHeaders(p, p.streaming);
+    t->body = requestBuf;
+    t->timeoutMs = p.timeoutMs > 0 && p.timeoutMs < timeoutMs ? p.timeoutMs : timeoutMs;
+    t->connectTimeoutMs = p.connectTimeoutMs;
+    applyRetryPolicy(*t, useControl ? 0 : retries, true);
+    AITransfer* raw = t.get();   // 不持有 shared_ptr，避免循环引用
+    t->onData = [stream, raw](const char* data, size_t len) {
+        // 解析耗时 = 本次处理耗时 - 其中回调（输出）的耗时
+        auto t0 = std::chrono::steady_clock::now();
+        double printBefore = stream->printMs;
+        feedStream(stream.get(), data, len);
+        if (stream->firstTokenMs == 0 && (!stream->reply.empty() || !stream->toolCalls.empty()))
+            stream->firstTokenMs = raw->elapsedMs();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        stream->parseMs += ms - (stream->printMs - printBefore);
+    };
+    t->onProgress = onProgress;
+    t->onDone = [this, stream, reply, useControl, hasUser, user, systemPrompt, tools, key, onToken, onProgress,
+        timeoutMs](AITransfer& done) {
+        // 控制接口连不上、超时或过载，且还没有输出任何内容：同一请求改发主接口，调用者只会看到稍晚的回复
+        if (useControl && !done.cancelled && stream->reply.empty() && stream->toolCalls.empty()
+            && (done.curlCode != 0 || done.httpStatus >= 500 || done.httpStatus == 429)) {
+            std::lock_guard<std::mutex> lk(mtx);
+            recordTiming(done, false, nullptr, 0, stream->parseMs, stream->printMs);
+            if (provider.usable()) {
+                controlDownUntil = std::chrono::steady_clock::now() + std::chrono::milliseconds(controlCooldownMs);
+                failovers++;
+                submitLocked(reply, false, hasUser, user, systemPrompt, tools, key, onToken, onProgress, timeoutMs);
+                return;
+            }
+        }
+        std::string text;
+        bool ok = finishReply(*stream, done, hasUser ? &user : nullptr, key, text, reply->toolCalls);
+        reply->cancelled = done.cancelled;
+        reply->timedOut = done.timedOut;
+        reply->complete(text, ok);
+    };
     {
-        Json::Value um;
-        um["role"] = "user";
-        um["content"] = userMessage;
-        messages.append(um);
+        // 改发主接口时在事件循环线程中替换，与 cancel 互斥
+        std::lock_guard<std::mutex> g(reply->m);
+        bool cancelled = reply->transfer && reply->transfer->isCancelRequested();
+        reply->transfer = t;
+        if (cancelled) t->cancel();
     }
+    transport.submit(t);
+}
 
-    root["model"] = "deepseek-chat";
-    root["messages"] = messages;
-    root["stream"] = true;
-    root["max_tokens"] = 2048;
-    root["temperature"] = 0.7;
+std::vector<AIBatchResult> DeepSeekAI::askBatch(const std::vector<std::string>& prompts,
+    const std::string& systemPrompt, const AIBatchOptions& options,
+    std::function<void(int done, int total)> onProgress) {
+    using namespace std::chrono;
+    int total = (int)prompts.size();
+    std::vector<AIBatchResult> results(total);
+    AIProvider p;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        p = provider;
+    }
+    if (!p.usable()) {
+        for (auto& r : results) r.text = "api未绑定";
+        return results;
+    }
 
-    Json::StreamWriterBuilder builder;
-    builder["indentation"] = "";
-    std::string requestData = Json::writeString(builder, root);
+    // 每个请求独立：系统提示词 + 一条用户消息，非流式应答
+    std::string head;
+    appendModel(head, p);
+    head += "\"messages\":[";
+    if (!systemPrompt.empty()) {
+        appendMessageJson(head, "system", systemPrompt);
+        head += ',';
+    }
 
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, requestData.c_str());
+    // 完成队列：事件循环线程写入请求序号，本线程取出后整理结果（重试在传输层完成）
+    std::mutex qm;
+    std::condition_variable qcv;
+    std::deque<int> finished;
+    std::vector<AITransferPtr> transfers(total);
+    std::vector<std::string> bodies(total);   // 应答内容
+    AIResponseFields fields;                  // 复用的字段提取结果
 
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, "Accept: application/json");
+    std::deque<int> queue;
+    for (int i = 0; i < total; i++)
+        queue.push_back(i);
 
-    std::string auth = "Authorization: Bearer " + apiKey;
-    headers = curl_slist_append(headers, auth.c_str());
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    int concurrency = options.concurrency > 0 ? options.concurrency : 1;
+    auto interval = options.requestsPerMinute > 0
+        ? milliseconds(60000 / options.requestsPerMinute) : milliseconds(0);
+    auto nextStart = steady_clock::now();
+    int inFlight = 0, completed = 0;
 
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    while (completed < total) {
+        // 按并发数与速率发起请求
+        auto now = steady_clock::now();
+        while (inFlight < concurrency && !queue.empty() && now >= nextStart) {
+            int index = queue.front();
+            queue.pop_front();
 
-    CURLcode res = curl_easy_perform(curl);
+            AITransferPtr t = std::make_shared<AITransfer>();
+            t->url = p.endpoint;
+            t->headers = requestHeaders(p, false);
+            t->connectTimeoutMs = p.connectTimeoutMs;
+            t->body = head;
+            appendMessageJson(t->body, "user", prompts[index]);
+            t->body += "],\"stream\":false,\"max_tokens\":2048,\"temperature\":0.7}";
+            t->timeoutMs = options.timeoutMs;
+            t->retries = options.retries;
+            t->retryDelayMs = options.retryDelayMs;
+            bodies[index].clear();
+            std::string* body = &bodies[index];
+            t->onData = [body](const char* data, size_t len) { body->append(data, len); };
+            t->onDone = [&, index](AITransfer&) {
+                std::lock_guard<std::mutex> lk(qm);
+                finished.push_back(index);
+                qcv.notify_one();
+            };
+            transfers[index] = t;
+            inFlight++;
+            nextStart = now + interval;
+            transport.submit(t);
+        }
 
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headers);
+        // 等待完成或下一个可发起的时间点
+        std::unique_lock<std::mutex> lk(qm);
+        auto wakeAt = now + milliseconds(100);
+        if (!queue.empty() && inFlight < concurrency && nextStart < wakeAt)
+            wakeAt = nextStart;
+        qcv.wait_until(lk, wakeAt, [&] { return !finished.empty(); });
 
-    if (res != CURLE_OK)
-        return std::string("Request error: ") + curl_easy_strerror(res);
+        while (!finished.empty()) {
+            int index = finished.front();
+            finished.pop_front();
+            lk.unlock();
+            inFlight--;
 
-    addMessage("user", userMessage);
-    return parseResponse(response);
+            AIBatchResult& r = results[index];
+            AITransfer& t = *transfers[index];
+            r.httpStatus = t.httpStatus;
+            r.totalMs = t.totalMs;
+            r.attempts = t.attempts;
+            double parseMs = 0;
+            if (t.curlCode != 0)
+                r.text = "Request error: " + t.error;
+            else {
+                const std::string& b = bodies[index];
+                auto t0 = steady_clock::now();
+                bool parsed = scanResponse(b.data(), b.size(), fields);
+                parseMs = duration<double, std::milli>(steady_clock::now() - t0).count();
+                if (!parsed)
+                    r.text = "Error: JSON parse failed\n原始数据：" + b;
+                else if (fields.hasError)
+                    r.text = "API Error: " + fields.errorMessage;
+                else {
+                    r.ok = true;
+                    r.text = fields.content;
+                    std::lock_guard<std::mutex> g(mtx);
+                    recordUsage(fields);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> g(mtx);
+                recordTiming(t, r.ok, r.ok ? &fields : nullptr, 0, parseMs, 0);
+            }
+            completed++;
+            if (onProgress) onProgress(completed, total);
+            lk.lock();
+        }
+    }
+    return results;
 }
 
-// -------- 保证 UTF-8 输出，不做任何转换 --------
-std::string DeepSeekAI::parseResponse(const std::string& jsonResponse) {
-    Json::Value root;
-    Json::CharReaderBuilder reader;
-    std::string errors;
-    std::stringstream ss(jsonResponse);
+// 在事件循环线程中调用：整理应答，写入历史、用量与缓存
+bool DeepSeekAI::finishReply(StreamState& stream, AITransfer& t, const std::string* userMessage,
+    uint64_t key, std::string& text, std::vector<AIToolCall>& toolCalls) {
+    // 先在锁外整理应答并输出剩余文本：onToken（显示、提前执行）中可以再调用 DeepSeekAI 的方法
+    bool parsed = true;
+    if (!t.cancelled && t.curlCode == 0) {
+        // 处理没有换行结尾的最后一行，并输出剩余的文本
+        if (!stream.line.empty())
+            handleLine(&stream, stream.line);
+        if (!stream.pending.empty() && stream.onToken)
+            stream.onToken(stream.pending);
 
-    if (!Json::parseFromStream(reader, ss, &root, &errors)) {
-        return "Error: JSON parse failed\n原始数据：" + jsonResponse;
+        // 非流式应答（如错误 JSON）：保证 UTF-8 输出，不做任何转换
+        if (!stream.isStream) {
+            AIResponseFields& f = stream.fields;
+            const std::string& raw = stream.raw;
+            auto t0 = std::chrono::steady_clock::now();
+            parsed = scanResponse(raw.data(), raw.size(), f);
+            stream.parseMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            if (parsed && f.hasError)
+                stream.error = f.errorMessage;
+            else if (parsed) {
+                stream.reply = f.content;
+                if (stream.onToken && !stream.reply.empty()) {
+                    auto p0 = std::chrono::steady_clock::now();
+                    stream.onToken(stream.reply);
+                    stream.printMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - p0).count();
+                }
+                for (int i = 0; i < f.toolCount; i++)
+                    stream.toolCalls.push_back({ f.toolCalls[i].id, f.toolCalls[i].name, f.toolCalls[i].arguments, "" });
+                if (f.hasUsage)
+                    copyUsage(f, stream.usage);
+            }
+        }
     }
 
-    if (root.isMember("error"))
-        return "API Error: " + root["error"]["message"].asString();
+    std::lock_guard<std::mutex> lk(mtx);
+    // 首字节时间；没有新建连接说明复用了上一次的连接
+    lastFirstByteMs = t.firstByteMs;
+    lastTotalMs = t.totalMs;
+    lastReused = t.reused;
 
-    std::string reply = root["choices"][0]["message"]["content"].asString();
+    if (t.cancelled) {
+        text = "请求已取消";
+        recordTiming(t, false, nullptr, stream.firstTokenMs, stream.parseMs, stream.printMs);
+        return false;
+    }
+    if (t.curlCode != 0) {
+        text = "Request error: " + t.error;
+        recordTiming(t, false, nullptr, stream.firstTokenMs, stream.parseMs, stream.printMs);
+        return false;
+    }
 
-    addMessage("assistant", reply);
-    return reply;
+    if (userMessage)
+        addMessage("user", *userMessage);
+
+    if (!parsed) {
+        text = "Error: JSON parse failed\n原始数据：" + stream.raw;
+        recordTiming(t, false, nullptr, 0, stream.parseMs, stream.printMs);
+        return false;
+    }
+
+    if (!stream.error.empty()) {
+        text = "API Error: " + stream.error;
+        recordTiming(t, false, nullptr, stream.firstTokenMs, stream.parseMs, stream.printMs);
+        return false;
+    }
+
+    recordUsage(stream.usage);
+    recordTiming(t, true, &stream.usage, stream.firstTokenMs, stream.parseMs, stream.printMs);
+    text = stream.reply;
+    if (!stream.toolCalls.empty()) {
+        addMessage("assistant", stream.reply, encodeToolCalls(stream.toolCalls));
+        toolCalls = stream.toolCalls;
+        return true;
+    }
+    addMessage("assistant", stream.reply);
+    if (cacheEnabled && key != 0 && !stream.reply.empty())
+        cache.put(key, stream.reply, cacheTtl);
+    return true;
 }
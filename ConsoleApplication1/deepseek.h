@@ -3,40 +3,316 @@
 
 #include <string>
 #include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <windows.h>
 #include <json/json.h>
+#include "aicache.h"
+#include "aihistlog.h"
+#include "jsonscan.h"
+#include "aitransport.h"
+#include "aiprovider.h"
+#include "aimetrics.h"
+
+// 工具调用（function calling）
+struct AIToolCall {
+    std::string id;         // 调用 id，回传结果时使用
+    std::string name;       // 函数名
+    std::string arguments;  // 参数（JSON 文本）
+    std::string result;     // 执行结果（JSON 文本），由调用者填写
+};
 
 // 消息结构体
 struct Message {
-    std::string role;     // "user" 或 "assistant"
-    std::string content;  // 内容
+    std::string role;       // "user"、"assistant" 或 "tool"
+    std::string content;    // 内容
+    int tokens = 0;         // 估算的 token 数
+    std::string toolCalls;  // assistant 发起的工具调用（已编码的 JSON 数组）
+    std::string toolCallId; // tool 消息对应的调用 id
+    std::string encoded;    // 已编码的 JSON 片段 {"role":..,"content":..}
+};
+
+// token 用量（来自应答中的 usage 字段），用于单次请求或整个会话的累计
+struct AIUsage {
+    int requests = 0;
+    long long promptTokens = 0;      // 输入 token = 缓存命中 + 未命中
+    long long completionTokens = 0;  // 输出 token
+    long long cacheHitTokens = 0;    // prompt_cache_hit_tokens
+    long long cacheMissTokens = 0;   // prompt_cache_miss_tokens
+    double cost = 0;                 // 按单价估算的费用（美元）
+
+    double hitRatio() const {
+        long long n = cacheHitTokens + cacheMissTokens;
+        return n > 0 ? (double)cacheHitTokens / n : 0;
+    }
+};
+
+// 固定容量的对话历史环形缓冲区，按 token 预算从最旧的消息开始淘汰
+class MessageRing
+{
+public:
+    explicit MessageRing(int capacity = 64);
+
+    void push(const std::string& role, const std::string& content, int tokens,
+        const std::string& toolCalls = "", const std::string& toolCallId = "");
+    void popFront();
+    void clear();
+
+    int size() const { return count; }
+    int tokens() const { return totalTokens; }
+    const Message& at(int i) const;   // 0 为最旧的消息
+    const Message& front() const { return at(0); }
+    // 最旧消息的序号（加入以来的编号），at(i) 的序号为 firstSeq() + i
+    long long firstSeq() const { return popped; }
+private:
+    std::vector<Message> slots;
+    int head = 0;        // 最旧消息所在槽位
+    int count = 0;
+    int totalTokens = 0;
+    long long popped = 0;   // 已淘汰的消息数
+};
+
+// 异步提问的句柄：可等待、取消，完成后取得回复
+class AIReply
+{
+public:
+    // 等待完成，超时返回 false；timeoutMs < 0 表示一直等待
+    bool wait(int timeoutMs = -1);
+    bool isReady() const;
+    // 取消请求（可在任意线程调用），完成后 isCancelled() 为 true
+    void cancel();
+    // 阻塞直到完成，返回回复文本或错误描述
+    std::string get();
+    bool succeeded() const;
+    bool isCancelled() const;
+    bool isTimedOut() const;
+    // 模型请求的工具调用，为空表示这是最终回复
+    const std::vector<AIToolCall>& getToolCalls() const;
+private:
+    friend class DeepSeekAI;
+    std::mutex m;
+    std::condition_variable cv;
+    std::atomic<bool> ready{ false };
+    std::string text;
+    bool ok = false;
+    bool cancelled = false;
+    bool timedOut = false;
+    std::vector<AIToolCall> toolCalls;
+    AITransferPtr transfer;
+
+    void complete(const std::string& result, bool success);
+};
+typedef std::shared_ptr<AIReply> AIReplyPtr;
+
+// 批量提问参数
+struct AIBatchOptions {
+    int concurrency = 4;          // 同时进行的请求数
+    int requestsPerMinute = 60;   // 发起请求的速率上限，0 表示不限制
+    int retries = 2;              // 网络错误、429、5xx 时的重试次数（在传输层完成，不占用速率额度）
+    int retryDelayMs = 1000;      // 第一次重试前的等待，之后每次加倍；应答带 Retry-After 时按其等待
+    int timeoutMs = 60000;        // 单个请求超时（含重试）
 };
 
+// 批量提问中单个请求的结果
+struct AIBatchResult {
+    bool ok = false;
+    std::string text;       // 回复内容或错误描述
+    int attempts = 0;       // 实际发送次数
+    long httpStatus = 0;
+    double totalMs = 0;     // 总耗时（含重试）
+};
+
+struct StreamState;
+
 class DeepSeekAI
 {
 public:
+    // 流式输出回调：每收到一段文本调用一次，保证不会在 UTF-8 字符中间截断
+    // 异步提问时在后台线程中调用
+    typedef std::function<void(const std::string& text)> TokenCallback;
+    // 进度回调：已接收字节数、已用时间（毫秒）
+    typedef std::function<void(long long received, double elapsedMs)> ProgressCallback;
+
     DeepSeekAI();
     ~DeepSeekAI();
     void setAPIKey(const std::string& key);
+    // 接口地址，默认 https://api.deepseek.com/v1/chat/completions，可指向本地替身或兼容服务
+    void setEndpoint(const std::string& url);
+    std::string getEndpoint() const;
+    // 主接口（地址、模型、Key、能力）：对话、批量提问与摘要都使用主接口；setAPIKey / setEndpoint 修改的也是主接口
+    void setProvider(const AIProvider& p);
+    AIProvider getProvider() const;
+    // 控制接口：延迟敏感的函数调用请求（askToolsAsync / continueWithTools）优先发往这里，通常是局域网内的推理服务
+    // 连接失败、超时或 5xx / 429 且还没有收到内容时，同一请求改发主接口，之后 cooldownMs 内不再尝试控制接口
+    void setControlProvider(const AIProvider& p, int cooldownMs = 30000);
+    void clearControlProvider();
+    bool hasControlProvider() const;
+    AIProvider getControlProvider() const;
+    // 上一次请求实际使用的接口名称，与从控制接口切换到主接口的累计次数
+    std::string getLastProviderName() const;
+    int getFailoverCount() const;
+    // 连接失败、429、5xx 时在传输层自动重试（还没有收到内容时才重试，调用者只看到最终结果）
+    // 等待从 delayMs 开始每次加倍，应答带 Retry-After 时按其等待；发往控制接口的请求不重试，失败直接改发主接口
+    void setRetryPolicy(int retries, int delayMs = 500);
+    int getRetries() const;
+    int getRetryDelayMs() const;
+    // 对冲请求：对话与函数调用请求超过最近首 token（非流式为首字节）时间的 p95 仍无内容时再发一份，先有内容的一方继续
+    // 至少有 20 个样本后生效；对冲请求也会计费，默认关闭
+    void setHedging(bool on);
+    bool isHedging() const;
     std::string ask(const std::string& userMessage);
+    std::string ask(const std::string& userMessage, TokenCallback onToken);
     std::string ask(const std::string& userMessage,
         const std::string& systemPrompt);
+    std::string ask(const std::string& userMessage,
+        const std::string& systemPrompt, TokenCallback onToken);
+    // 异步提问：立即返回句柄，请求在后台事件循环中执行，不阻塞调用线程
+    // 同步的 ask 等价于 askAsync(...)->get()
+    AIReplyPtr askAsync(const std::string& userMessage, const std::string& systemPrompt,
+        TokenCallback onToken, ProgressCallback onProgress = ProgressCallback(), int timeoutMs = 30000);
+    // 工具调用：tools 为 OpenAI 兼容的工具定义 JSON 数组
+    // 回复带工具调用时 getToolCalls() 非空；执行后填写每个调用的 result，
+    // 用 continueWithTools 把结果交回模型，得到同一轮对话的后续回复
+    // 工具请求的结果依赖 PLC 当前状态，不使用本地缓存
+    AIReplyPtr askToolsAsync(const std::string& userMessage, const std::string& systemPrompt,
+        const std::string& tools, TokenCallback onToken = nullptr, int timeoutMs = 30000);
+    AIReplyPtr continueWithTools(const std::vector<AIToolCall>& calls, const std::string& systemPrompt,
+        const std::string& tools, TokenCallback onToken = nullptr, int timeoutMs = 30000);
+    // 批量提问：每条提示词独立（不带历史、不写入历史），按并发数与速率限制同时执行
+    // 阻塞直到全部完成，结果顺序与 prompts 一致；onProgress 在调用线程中回调（已完成数, 总数）
+    std::vector<AIBatchResult> askBatch(const std::vector<std::string>& prompts,
+        const std::string& systemPrompt, const AIBatchOptions& options = AIBatchOptions(),
+        std::function<void(int done, int total)> onProgress = nullptr);
     void showHistory();
     void clearHistory();
+
+    // 上一次请求的耗时分解（curl 各阶段、首 token、生成速度、本地解析与输出）与 token 数
+    AIRequestTiming getLastTiming() const;
+    // 最近请求（对话、函数调用、批量、摘要）各项指标的滚动百分位
+    AILatencyStats getLatencyStats() const;
+    void clearLatencyStats();
+    // 上一次请求的首字节时间（毫秒，从发起请求到收到第一个字节）
+    double getLastFirstByteMs() const;
+    // 上一次请求是否复用了已有连接（没有重新做 DNS / TCP / TLS）
+    bool lastConnectionReused() const;
+    // 上一次请求体字节数与总耗时（毫秒）
+    size_t getLastRequestBytes() const;
+    double getLastTotalMs() const;
+
+    // 历史 token 预算（不含系统提示词，系统提示词每次都会完整发送）
+    void setTokenBudget(int tokens);
+    int getTokenBudget() const;
+    int getHistoryTokens() const;
+    // 历史中最旧消息的序号：历史被清空、淘汰或摘要后会变大，可据此判断模型是否还能看到之前的消息
+    long long getHistoryFirstSeq() const;
+    // 粗略估算 token 数：ASCII 约 0.3 token/字符，中文等约 0.6 token/字符
+    static int estimateTokens(const std::string& utf8);
+
+    // 上一次请求与本次会话累计的 token 用量、缓存命中和费用（返回副本：后台线程随时会更新）
+    AIUsage getLastUsage() const;
+    AIUsage getSessionUsage() const;
+    // 单价：每百万 token 的美元价格（缓存命中输入 / 未命中输入 / 输出）
+    void setPricing(double hitPerM, double missPerM, double outputPerM);
+
+    // 本地回复缓存：键为 系统提示词 + 规范化后的用户消息 + 最近一轮对话 的哈希
+    // file 为内存映射的持久化文件，为空时只在内存中缓存
+    void enableCache(const std::string& file, int capacity = 256, int ttlSec = 3600);
+    void disableCache();
+    bool isCacheEnabled() const;
+    AICacheStats getCacheStats() const;
+    // 上一次回复是否来自本地缓存（未发出网络请求）
+    bool lastFromCache() const;
+
+    // 对话历史日志：之后的每条消息追加写入 file，打开时从日志尾部恢复预算内的最近历史
+    // 返回恢复的消息数，打开失败返回 -1；清空历史时写入会话边界，恢复不会越过边界
+    int openLog(const std::string& file);
+    void closeLog();
+    bool isLogOpen() const;
+    AILogStats getLogStats() const;
+    // 只保留最近的历史重写日志文件（日志超过阈值时也会自动压缩）
+    bool compactLog();
+
+    // 历史摘要：历史超过 thresholdTokens 时，在后台请求模型把最早的几轮对话压缩成一段摘要，
+    // 完成后用摘要替换这些消息（摘要作为第二条 system 消息放在历史之前）
+    // thresholdTokens 为 0 时取预算的一半；摘要请求不阻塞当前提问
+    void setSummarize(bool enabled, int thresholdTokens = 0);
+    std::string getSummary() const;
+    int getSummaryCount() const;
 private:
-    std::string apiKey;
-    std::vector<Message> history;
+    AIProvider provider;            // 主接口
+    AIProvider control;             // 控制接口
+    bool hasControl = false;
+    int controlCooldownMs = 30000;
+    std::chrono::steady_clock::time_point controlDownUntil;   // 此前不使用控制接口
+    int failovers = 0;
+    std::string lastProvider;
+    int retries = 2;
+    int retryDelayMs = 500;
+    bool hedging = false;
+    mutable std::mutex mtx;    // 保护历史、统计与缓存（请求在后台线程中完成）
+    double lastFirstByteMs = 0;
+    bool lastReused = false;
+    size_t lastRequestBytes = 0;
+    double lastTotalMs = 0;
+    int tokenBudget = 4000;
+    AIUsage lastUsage;
+    AIUsage sessionUsage;
+    AIRequestTiming lastTiming;
+    AILatencyStats latency;
+    double priceHit = 0.028, priceMiss = 0.28, priceOutput = 0.42;
+    AICache cache;
+    bool cacheEnabled = false;
+    int cacheTtl = 3600;
+    bool lastCached = false;
+    AIHistoryLog log;
+    MessageRing history;
+    // 历史摘要
+    bool summarizeEnabled = true;
+    int summarizeThreshold = 0;
+    std::string summary;            // 当前摘要（替换掉的最早几轮对话）
+    int summaryTokens = 0;
+    int summaryCount = 0;           // 已完成的摘要次数
+    AITransferPtr summaryTransfer;  // 进行中的摘要请求
+    // 已编码的请求前缀：{"model":..,"messages":[系统提示词, 历史消息...
+    // 新消息直接追加，只有淘汰旧消息或系统提示词变化时才重新拼接
+    std::string prefix;
+    std::string prefixSystem;
+    std::string prefixTools;
+    std::string prefixModel;
+    bool prefixValid = false;
+    std::string requestBuf;    // 复用的请求体缓冲区
     bool systemPromptUsed = false;
     std::string lastPrompt = "";  
+    // 后台事件循环，连接在多次提问之间保持
+    // 放在最后：析构时最先停止，未完成请求的回调仍能访问上面的成员
+    AITransport transport;
 
-    void addMessage(const std::string& role, const std::string& content);
+    void addMessage(const std::string& role, const std::string& content,
+        const std::string& toolCalls = "", const std::string& toolCallId = "");
 
-    // 支持 systemPrompt
-    std::string callAPI(const std::string& userMessage,
-        const std::string& systemPrompt);
+    // 发送一次请求：userMessage 为空指针时不追加用户消息（工具结果之后的续写）；key 为 0 不使用缓存
+    AIReplyPtr sendAsync(const std::string* userMessage, const std::string& systemPrompt,
+        const std::string& tools, uint64_t key, TokenCallback onToken, ProgressCallback onProgress, int timeoutMs);
+    // 在持有 mtx 时调用：按接口 p 构造请求并提交，结果写入 reply；useControl 为 true 时失败可改发主接口
+    void submitLocked(const AIReplyPtr& reply, bool useControl, bool hasUser, const std::string& user,
+        const std::string& systemPrompt, const std::string& tools, uint64_t key,
+        TokenCallback onToken, ProgressCallback onProgress, int timeoutMs);
+    bool finishReply(StreamState& stream, AITransfer& t, const std::string* userMessage,
+        uint64_t key, std::string& text, std::vector<AIToolCall>& toolCalls);
 
-    // JSON 解析
-    std::string parseResponse(const std::string& jsonResponse);
+    void rebuildPrefix(const std::string& model, const std::string& systemPrompt, const std::string& tools);
+    // 在持有 mtx 时调用：历史超过阈值且没有进行中的摘要请求时发起摘要
+    void maybeSummarize();
+    void finishSummary(AITransfer& t, const std::string& body, long long endSeq);
+    void recordUsage(const AIResponseFields& usage, bool last = true);
+    // 在持有 mtx 时调用：记录一次请求的耗时分解；last 为 false 时不覆盖上一次请求（后台摘要）
+    // firstTokenMs 为 0 表示非流式应答（没有首 token 时间）
+    void recordTiming(const AITransfer& t, bool ok, const AIResponseFields* usage,
+        double firstTokenMs, double parseMs, double printMs, bool last = true);
+    uint64_t cacheKey(const std::string& userMessage, const std::string& systemPrompt) const;
+    // 在持有 mtx 时调用：按重试与对冲设置填写传输参数
+    void applyRetryPolicy(AITransfer& t, int maxRetries, bool hedge);
 };
 
 #endif // DEEPSEEK_H
@@ -0,0 +1,105 @@
+﻿#include "earlycmd.h"
+#include "plcclient.h"
+#include <sstream>
+#include <cctype>
+#include <cstdint>
+
+EarlyCommandRunner::~EarlyCommandRunner()
+{
+    wait();
+}
+
+void EarlyCommandRunner::begin(PLCClient& plc)
+{
+    wait();
+    std::lock_guard<std::mutex> guard(lock);
+    this->plc = &plc;
+    pending.clear();
+    running = false;
+    text.clear();
+    parsed = PLCIntent();
+    results.clear();
+    ok.clear();
+    elapsedMs = 0;
+}
+
+static std::string trim(const std::string& s)
+{
+    size_t b = 0, e = s.size();
+    while (b < e && isspace((unsigned char)s[b])) b++;
+    while (e > b && isspace((unsigned char)s[e - 1])) e--;
+    return s.substr(b, e - b);
+}
+
+bool EarlyCommandRunner::parse(PLCClient& plc, const std::string& command, PLCIntent& intent)
+{
+    intent = PLCIntent();
+    std::istringstream ss(command);
+    std::string op, addr, rest;
+    ss >> op >> addr;
+    int area, db, start, bit, size;
+    if (addr.empty() || !plc.parseAddress(addr, area, db, start, bit, size))
+        return false;
+    if (op == "read") {
+        if (ss >> rest) return false;
+        intent.kind = PLCIntent::Read;
+    }
+    else if (op == "write") {
+        long long value;
+        if (!(ss >> value) || (ss >> rest) || value < INT32_MIN || value > INT32_MAX) return false;
+        intent.kind = PLCIntent::Write;
+        intent.value = (int32_t)value;
+    }
+    else
+        return false;
+    intent.addresses.push_back(addr);
+    return true;
+}
+
+void EarlyCommandRunner::feed(const std::string& chunk)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (running || !plc) return;
+    pending += chunk;
+    size_t nl;
+    while (!running && (nl = pending.find('\n')) != std::string::npos) {
+        std::string line = trim(pending.substr(0, nl));
+        pending.erase(0, nl + 1);
+        if (line.rfind("C:", 0) != 0) continue;
+        std::string command = trim(line.substr(2));
+        // none 或格式不对的指令留给回复结束后的解析处理
+        if (!parse(*plc, command, parsed)) continue;
+        text = command;
+        running = true;
+        startTime = std::chrono::steady_clock::now();
+        worker = std::thread(&EarlyCommandRunner::execute, this);
+    }
+}
+
+void EarlyCommandRunner::execute()
+{
+    IntentMatcher::execute(*plc, parsed, results, ok);
+    doneTime = std::chrono::steady_clock::now();
+    elapsedMs = std::chrono::duration<double, std::milli>(doneTime - startTime).count();
+}
+
+void EarlyCommandRunner::wait()
+{
+    if (worker.joinable())
+        worker.join();
+}
+
+void EarlyCommandRunner::finish(std::chrono::steady_clock::time_point replyDone)
+{
+    wait();
+    std::lock_guard<std::mutex> guard(lock);
+    stats.lastSavedMs = stats.lastLeadMs = 0;
+    if (!running) return;
+    // 顺序执行时端到端 = 回复结束 + PLC 耗时；提前执行时 = 回复结束与 PLC 完成中较晚的一个
+    double replyMs = std::chrono::duration<double, std::milli>(replyDone - startTime).count();
+    stats.commands++;
+    stats.early++;
+    stats.lastLeadMs = replyMs > 0 ? replyMs : 0;
+    stats.lastSavedMs = elapsedMs < stats.lastLeadMs ? elapsedMs : stats.lastLeadMs;
+    stats.savedMs += stats.lastSavedMs;
+}
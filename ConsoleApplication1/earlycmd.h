@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include "intent.h"
+
+class PLCClient;
+
+// 提前执行的统计
+struct EarlyCommandStats
+{
+    long long commands = 0;     // 带 C: 指令的回复数
+    long long early = 0;        // 在回复结束前开始执行的次数
+    double savedMs = 0;         // 累计节省的端到端时间
+    double lastSavedMs = 0;     // 上一轮节省的时间
+    double lastLeadMs = 0;      // 上一轮指令开始执行时距回复结束还有多久
+};
+
+// EarlyCommandRunner：在流式回复中逐行识别 C: 指令，行一结束就交给 PLC 执行
+// 模型输出 C: 行之后往往还会继续输出说明文字，PLC 通信与这段生成时间重叠
+// 只执行每轮第一条格式正确的 read / write 指令（地址须能被 PLCClient 解析），PLC 操作在单独的线程中进行，
+// 不阻塞接收流式数据的线程；finish 之前控制台线程不得使用同一个 PLCClient
+class EarlyCommandRunner
+{
+public:
+    ~EarlyCommandRunner();
+
+    // 开始新的一轮
+    void begin(PLCClient& plc);
+    // 接收一段流式文本（在 TokenCallback 中调用）
+    void feed(const std::string& text);
+    // 等待已开始的指令执行完毕（工具调用轮次中使用 PLC 之前调用）
+    void wait();
+    // 回复结束：等待已开始的指令执行完毕，按 replyDone（收到完整回复的时间）计算节省的时间
+    void finish(std::chrono::steady_clock::time_point replyDone);
+
+    // 本轮是否已提前执行，command 为执行的指令文本（如 "write Q0.0 1"）
+    bool started() const { return running; }
+    const std::string& command() const { return text; }
+    const PLCIntent& intent() const { return parsed; }
+    const std::vector<int32_t>& values() const { return results; }
+    const std::vector<bool>& succeeded() const { return ok; }
+    double plcMs() const { return elapsedMs; }
+
+    // 解析一条 C: 指令（不含 "C:"）："read 地址" 或 "write 地址 值"
+    static bool parse(PLCClient& plc, const std::string& command, PLCIntent& intent);
+
+    // 回复结束后在控制台线程中调用，记录没有提前执行的 C: 指令
+    void recordLate() { stats.commands++; }
+    const EarlyCommandStats& getStats() const { return stats; }
+private:
+    PLCClient* plc = nullptr;
+    std::mutex lock;                // 保护 pending / running
+    std::string pending;            // 未结束的行
+    bool running = false;
+    std::string text;
+    PLCIntent parsed;
+    std::vector<int32_t> results;
+    std::vector<bool> ok;
+    double elapsedMs = 0;
+    std::chrono::steady_clock::time_point startTime, doneTime;
+    std::thread worker;
+    EarlyCommandStats stats;
+
+    void execute();
+};
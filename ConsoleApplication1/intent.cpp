@@ -0,0 +1,301 @@
+﻿#include "intent.h"
+#include "plcclient.h"
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+
+// 关键字类别
+enum WordKind { ReadWord, WriteWord, ToggleWord, OnWord, OffWord, Filler, Question };
+struct Keyword { const char* text; WordKind kind; };
+
+// 按最长匹配查找，顺序无关；英文关键字只在单词边界处匹配（输入已转小写）
+static const Keyword keywords[] = {
+    { u8"读取", ReadWord }, { u8"读一下", ReadWord }, { u8"读", ReadWord }, { u8"查看", ReadWord },
+    { u8"查询", ReadWord }, { u8"看看", ReadWord }, { u8"看一下", ReadWord }, { u8"看", ReadWord },
+    { u8"检查", ReadWord }, { u8"显示", ReadWord }, { u8"状态", ReadWord }, { u8"多少", ReadWord },
+    { u8"是多少", ReadWord }, { u8"值", ReadWord },
+    { "read", ReadWord }, { "get", ReadWord }, { "show", ReadWord }, { "check", ReadWord },
+    { "status", ReadWord }, { "state", ReadWord }, { "value", ReadWord }, { "what", ReadWord },
+
+    { u8"写入", WriteWord }, { u8"写", WriteWord }, { u8"置为", WriteWord }, { u8"置", WriteWord },
+    { u8"设为", WriteWord }, { u8"设置为", WriteWord }, { u8"设置", WriteWord }, { u8"设", WriteWord },
+    { u8"改为", WriteWord }, { u8"改成", WriteWord },
+    { "write", WriteWord }, { "set", WriteWord },
+
+    { u8"切换", ToggleWord }, { u8"取反", ToggleWord }, { u8"翻转", ToggleWord }, { u8"反转", ToggleWord },
+    { "toggle", ToggleWord }, { "flip", ToggleWord }, { "invert", ToggleWord },
+
+    { u8"打开", OnWord }, { u8"开启", OnWord }, { u8"启动", OnWord }, { u8"接通", OnWord }, { u8"开", OnWord },
+    { "on", OnWord }, { "open", OnWord }, { "start", OnWord },
+
+    { u8"关闭", OffWord }, { u8"关掉", OffWord }, { u8"停止", OffWord }, { u8"断开", OffWord },
+    { u8"关", OffWord }, { u8"停", OffWord },
+    { "off", OffWord }, { "close", OffWord }, { "stop", OffWord },
+
+    { u8"把", Filler }, { u8"将", Filler }, { u8"请", Filler }, { u8"帮我", Filler }, { u8"给我", Filler },
+    { u8"一下", Filler }, { u8"的", Filler }, { u8"吧", Filler }, { u8"是", Filler }, { u8"当前", Filler },
+    { u8"现在", Filler }, { u8"和", Filler }, { u8"与", Filler }, { u8"及", Filler },
+    { "please", Filler }, { "the", Filler }, { "now", Filler }, { "current", Filler },
+    { "of", Filler }, { "and", Filler }, { "turn", Filler }, { "to", Filler },
+
+    // 疑问或状态描述（"Q0.0 开了吗"、"is Q0.0 on?"）：不能当作写入指令
+    { u8"吗", Question }, { u8"呢", Question }, { u8"么", Question }, { u8"了", Question }, { u8"没", Question },
+    { u8"是否", Question }, { u8"？", Question }, { "?", Question },
+    { "is", Question }, { "are", Question }, { "does", Question }, { "did", Question }, { "whether", Question },
+};
+
+// 分隔符：空白与常见中英文标点（问号是疑问标记，不在其中）
+static size_t separatorLength(const std::string& s, size_t i)
+{
+    static const char* const seps[] = {
+        u8"，", u8"。", u8"！", u8"、", u8"：", u8"；", u8"　",
+    };
+    char c = s[i];
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == '.' || c == '!'
+        || c == ':' || c == ';')
+        return 1;
+    for (const char* sep : seps) {
+        size_t n = strlen(sep);
+        if (s.compare(i, n, sep) == 0) return n;
+    }
+    return 0;
+}
+
+static bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// 地址：字母 + 数字，后面可跟若干段 "." + 字母（可省略）+ 数字，如 I0.0、MW100、DB1.DBX0.0、HR10.3
+static size_t addressLength(const std::string& s, size_t i)
+{
+    size_t j = i, letters = 0;
+    while (j < s.size() && isAlpha(s[j]) && letters < 4) { j++; letters++; }
+    if (letters == 0 || j >= s.size() || !isDigit(s[j])) return 0;
+    while (j < s.size() && isDigit(s[j])) j++;
+    while (j + 1 < s.size() && s[j] == '.') {
+        size_t k = j + 1;
+        while (k < s.size() && isAlpha(s[k]) && k - j <= 4) k++;
+        if (k >= s.size() || !isDigit(s[k])) break;
+        while (k < s.size() && isDigit(s[k])) k++;
+        j = k;
+    }
+    if (j < s.size() && isAlpha(s[j])) return 0;
+    return j - i;
+}
+
+// 位地址：最后一段为位号（I0.0、DB1.DBX0.0、HR10.3），或 Modbus 线圈 / 离散输入（C12、DI3）
+static bool isBitAddress(const std::string& addr)
+{
+    size_t dot = addr.rfind('.');
+    if (dot != std::string::npos) {
+        if (dot + 1 >= addr.size()) return false;
+        for (size_t i = dot + 1; i < addr.size(); i++)
+            if (!isDigit(addr[i])) return false;
+        return true;
+    }
+    size_t n = addr.compare(0, 2, "DI") == 0 ? 2 : addr.compare(0, 1, "C") == 0 ? 1 : 0;
+    if (n == 0 || n >= addr.size()) return false;
+    for (size_t i = n; i < addr.size(); i++)
+        if (!isDigit(addr[i])) return false;
+    return true;
+}
+
+std::string PLCIntent::describe() const
+{
+    std::string out = kind == Read ? "read" : kind == Write ? "write" : kind == Toggle ? "toggle" : "none";
+    for (auto& a : addresses) out += " " + a;
+    if (kind == Write) out += " " + std::to_string(value);
+    return out;
+}
+
+void IntentMatcher::addTag(const std::string& name, const std::string& address)
+{
+    if (name.empty()) return;
+    // 英文字母不区分大小写：按小写保存，与转成小写的输入比较
+    std::string lower = name;
+    for (char& c : lower)
+        if (c >= 'A' && c <= 'Z') c = (char)(c + 32);
+    tags.push_back({ lower, address });
+    std::stable_sort(tags.begin(), tags.end(), [](const Tag& a, const Tag& b) { return a.name.size() > b.name.size(); });
+}
+
+int IntentMatcher::loadTags(const std::string& file)
+{
+    std::ifstream in(file);
+    if (!in) return -1;
+    int n = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (n == 0 && line.rfind("\xEF\xBB\xBF", 0) == 0) line = line.substr(3);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == std::string::npos) continue;
+        std::string name = line.substr(0, eq), address = line.substr(eq + 1);
+        while (!name.empty() && name.back() == ' ') name.pop_back();
+        while (!address.empty() && address[0] == ' ') address.erase(0, 1);
+        while (!address.empty() && address.back() == ' ') address.pop_back();
+        if (name.empty() || address.empty()) continue;
+        addTag(name, address);
+        n++;
+    }
+    return n;
+}
+
+bool IntentMatcher::match(const std::string& utf8, PLCIntent& intent) const
+{
+    intent = PLCIntent();
+    std::string lower = utf8;
+    for (char& c : lower)
+        if (c >= 'A' && c <= 'Z') c = (char)(c + 32);
+
+    std::vector<int32_t> numbers;
+    bool read = false, write = false, toggle = false, on = false, off = false;
+    size_t i = 0;
+    while (i < lower.size()) {
+        size_t n = separatorLength(lower, i);
+        if (n > 0) {
+            i += n;
+            continue;
+        }
+
+        // 标签名
+        bool found = false;
+        for (auto& t : tags) {
+            if (lower.compare(i, t.name.size(), t.name) == 0) {
+                intent.addresses.push_back(t.address);
+                i += t.name.size();
+                found = true;
+                break;
+            }
+        }
+        if (found) continue;
+
+        // PLC 地址，统一转成大写
+        n = addressLength(lower, i);
+        if (n > 0) {
+            std::string addr = utf8.substr(i, n);
+            for (char& c : addr)
+                if (c >= 'a' && c <= 'z') c = (char)(c - 32);
+            intent.addresses.push_back(addr);
+            i += n;
+            continue;
+        }
+
+        // 数值
+        if (isDigit(lower[i]) || (lower[i] == '-' && i + 1 < lower.size() && isDigit(lower[i + 1]))) {
+            size_t j = i + 1;
+            while (j < lower.size() && isDigit(lower[j])) j++;
+            if (j < lower.size() && (isAlpha(lower[j]) || (lower[j] == '.' && j + 1 < lower.size() && isDigit(lower[j + 1]))))
+                return false;   // 小数或 "1号泵" 之类未登记的名称
+            numbers.push_back((int32_t)atol(lower.c_str() + i));
+            i = j;
+            continue;
+        }
+
+        // 关键字（最长匹配）
+        const Keyword* best = nullptr;
+        size_t bestLen = 0;
+        for (const Keyword& k : keywords) {
+            size_t len = strlen(k.text);
+            if (len <= bestLen || lower.compare(i, len, k.text) != 0) continue;
+            if (isAlpha(k.text[0]) && i + len < lower.size() && (isAlpha(lower[i + len]) || isDigit(lower[i + len])))
+                continue;
+            best = &k;
+            bestLen = len;
+        }
+        if (!best) return false;   // 无法识别的内容：交给 AI
+        switch (best->kind) {
+        case ReadWord: read = true; break;
+        case WriteWord: write = true; break;
+        case ToggleWord: toggle = true; break;
+        case OnWord: on = true; break;
+        case OffWord: off = true; break;
+        case Filler: break;
+        case Question: return false;   // 疑问句交给 AI，避免把询问状态当成开关指令
+        }
+        i += bestLen;
+    }
+
+    if (intent.addresses.empty()) return false;
+    // 重复或矛盾的说法（如 "打开 Q0.0 置 1"、"读 Q0.0 并取反"）视为不明确
+    if ((toggle ? 1 : 0) + (on ? 1 : 0) + (off ? 1 : 0) > 1) return false;
+    // 取反与开关只用于位地址，"取反 MW100" 之类交给 AI
+    if (toggle || on || off) {
+        for (auto& a : intent.addresses)
+            if (!isBitAddress(a)) return false;
+    }
+    if (toggle) {
+        if (read || write || !numbers.empty()) return false;
+        intent.kind = PLCIntent::Toggle;
+        return true;
+    }
+    if (on || off) {
+        if (read || !numbers.empty()) return false;
+        intent.kind = PLCIntent::Write;
+        intent.value = on ? 1 : 0;
+        return true;
+    }
+    if (write) {
+        if (numbers.size() != 1) return false;
+        intent.kind = PLCIntent::Write;
+        intent.value = numbers[0];
+        return true;
+    }
+    // 只有地址（可带读取类动词），没有多余的数值
+    if (!numbers.empty()) return false;
+    intent.kind = PLCIntent::Read;
+    return true;
+}
+
+bool IntentMatcher::execute(PLCClient& plc, const PLCIntent& intent, std::vector<int32_t>& values, std::vector<bool>& ok)
+{
+    switch (intent.kind) {
+    case PLCIntent::Read:
+        return plc.readAddresses(intent.addresses, values, &ok);
+    case PLCIntent::Write:
+        values.assign(intent.addresses.size(), intent.value);
+        return plc.writeAddresses(intent.addresses, values, &ok);
+    case PLCIntent::Toggle: {
+        // 只写回读取成功的地址
+        std::vector<bool> readOk;
+        plc.readAddresses(intent.addresses, values, &readOk);
+        std::vector<std::string> addrs;
+        std::vector<int32_t> flipped;
+        std::vector<size_t> index;
+        for (size_t i = 0; i < values.size(); i++) {
+            if (!readOk[i]) continue;
+            values[i] = values[i] ? 0 : 1;
+            addrs.push_back(intent.addresses[i]);
+            flipped.push_back(values[i]);
+            index.push_back(i);
+        }
+        ok.assign(values.size(), false);
+        std::vector<bool> writeOk;
+        if (!addrs.empty())
+            plc.writeAddresses(addrs, flipped, &writeOk);
+        bool all = addrs.size() == values.size();
+        for (size_t k = 0; k < addrs.size(); k++) {
+            ok[index[k]] = writeOk[k];
+            if (!writeOk[k]) all = false;
+        }
+        return all;
+    }
+    default:
+        values.clear();
+        ok.clear();
+        return false;
+    }
+}
+
+void IntentMatcher::recordFast(double ms)
+{
+    stats.inputs++;
+    stats.hits++;
+    stats.fastMs += ms;
+}
+
+void IntentMatcher::recordAI(double ms)
+{
+    stats.inputs++;
+    stats.aiTurns++;
+    stats.aiMs += ms;
+}
@@ -0,0 +1,63 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class PLCClient;
+
+// 本地识别出的 PLC 指令
+struct PLCIntent
+{
+    enum Kind { None, Read, Write, Toggle };
+    Kind kind = None;
+    std::vector<std::string> addresses;   // 已按标签字典换成 PLC 地址
+    int32_t value = 0;                    // Write 时写入的值
+
+    // 形如 "read I0.0 MW100" / "write Q0.1 1" / "toggle Q0.0"
+    std::string describe() const;
+};
+
+// 快速通道统计：命中本地匹配的输入与交给 AI 的输入分别计时
+struct IntentStats
+{
+    long long inputs = 0;       // 总输入数
+    long long hits = 0;         // 本地直接执行的次数
+    double fastMs = 0;          // 本地执行累计耗时
+    long long aiTurns = 0;      // 交给 AI 的次数
+    double aiMs = 0;            // AI 轮次累计耗时（含 PLC 执行）
+
+    double hitRatio() const { return inputs > 0 ? (double)hits / inputs : 0; }
+    // 按 AI 轮次的平均耗时估算快速通道节省的时间
+    double savedMs() const {
+        if (aiTurns == 0 || hits == 0) return 0;
+        return hits * (aiMs / aiTurns) - fastMs;
+    }
+};
+
+// IntentMatcher：中英文简单读写指令的本地识别，命中时不经过 AI
+// 支持 "读 I0.0"、"把 Q0.1 置 1"、"打开 1号泵"、"MW100 设为 25"、"toggle Q0.0"、"read MW100 MW102" 等说法
+// 输入中除地址、标签名、动词、数值与少量虚词外不能有其它内容，否则视为不明确，交给 AI 处理
+// 疑问句（吗、呢、了、是否、?、is ... 等）一律交给 AI；取反与开关只接受位地址
+class IntentMatcher
+{
+public:
+    // 标签字典：名称 -> 地址（英文字母不区分大小写，按最长匹配）
+    void addTag(const std::string& name, const std::string& address);
+    // 从文件加载标签，每行 "名称=地址"，UTF-8 编码，# 开头为注释；返回加载的条数，文件打不开返回 -1
+    int loadTags(const std::string& file);
+    int tagCount() const { return (int)tags.size(); }
+
+    // 识别 UTF-8 输入，成功返回 true
+    bool match(const std::string& utf8, PLCIntent& intent) const;
+
+    // 执行指令：读取 / 写入 / 取反，values 为每个地址的结果值（读到的值或写入的值），ok 为每个地址是否成功
+    static bool execute(PLCClient& plc, const PLCIntent& intent, std::vector<int32_t>& values, std::vector<bool>& ok);
+
+    void recordFast(double ms);
+    void recordAI(double ms);
+    const IntentStats& getStats() const { return stats; }
+private:
+    struct Tag { std::string name; std::string address; };
+    std::vector<Tag> tags;      // 按名称长度从长到短排列
+    IntentStats stats;
+};
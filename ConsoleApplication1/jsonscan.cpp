@@ -0,0 +1,420 @@
+﻿#include "jsonscan.h"
+#include <json/json.h>
+#include <chrono>
+#include <cstring>
+
+JsonScanner::JsonScanner(const char* data, size_t len)
+    : p(data), end(data + len)
+{
+}
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+JsonScanner::Token JsonScanner::next()
+{
+    while (p < end) {
+        char c = *p;
+        if (isSpace(c) || c == ':') {
+            p++;
+            continue;
+        }
+        if (c == ',') {
+            p++;
+            expectKey = level > 0 && objectStack[level - 1];
+            continue;
+        }
+        break;
+    }
+    if (p >= end)
+        return level == 0 ? End : Error;
+
+    char c = *p;
+    switch (c) {
+    case '{':
+    case '[':
+        if (level == maxDepth) return Error;
+        objectStack[level++] = c == '{';
+        expectKey = c == '{';
+        p++;
+        return c == '{' ? ObjectBegin : ArrayBegin;
+    case '}':
+    case ']':
+        if (level == 0 || objectStack[level - 1] != (c == '}')) return Error;
+        level--;
+        expectKey = false;
+        p++;
+        return c == '}' ? ObjectEnd : ArrayEnd;
+    case '"': {
+        // 只找结束引号，转义在 decode 时处理
+        const char* s = ++p;
+        escaped = false;
+        while (p < end && *p != '"') {
+            if (*p == '\\') {
+                escaped = true;
+                p++;
+            }
+            p++;
+        }
+        if (p >= end) return Error;
+        tokenStart = s;
+        tokenLength = p - s;
+        p++;
+        bool key = expectKey;
+        expectKey = false;
+        return key ? Key : String;
+    }
+    case 't':
+        if (end - p >= 4 && memcmp(p, "true", 4) == 0) { p += 4; return True; }
+        return Error;
+    case 'f':
+        if (end - p >= 5 && memcmp(p, "false", 5) == 0) { p += 5; return False; }
+        return Error;
+    case 'n':
+        if (end - p >= 4 && memcmp(p, "null", 4) == 0) { p += 4; return Null; }
+        return Error;
+    default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            tokenStart = p;
+            while (p < end && (*p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E' || (*p >= '0' && *p <= '9')))
+                p++;
+            tokenLength = p - tokenStart;
+            return Number;
+        }
+        return Error;
+    }
+}
+
+bool JsonScanner::skip(Token token)
+{
+    if (token == Error || token == End) return false;
+    if (token != ObjectBegin && token != ArrayBegin) return true;
+    int target = level - 1;
+    while (level > target) {
+        Token t = next();
+        if (t == Error || t == End) return false;
+    }
+    return true;
+}
+
+bool JsonScanner::skipValue()
+{
+    return skip(next());
+}
+
+bool JsonScanner::is(const char* s) const
+{
+    size_t n = strlen(s);
+    return n == tokenLength && memcmp(tokenStart, s, n) == 0;
+}
+
+static void appendUtf8(std::string& out, unsigned cp)
+{
+    if (cp < 0x80)
+        out += (char)cp;
+    else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+    else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+static bool hex4(const char* s, const char* end, unsigned& v)
+{
+    if (end - s < 4) return false;
+    v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = s[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+void JsonScanner::decode(std::string& out) const
+{
+    if (!escaped) {
+        out.assign(tokenStart, tokenLength);
+        return;
+    }
+    out.clear();
+    const char* s = tokenStart;
+    const char* e = tokenStart + tokenLength;
+    while (s < e) {
+        // 连续的普通字符整段追加
+        const char* bs = (const char*)memchr(s, '\\', e - s);
+        if (!bs) {
+            out.append(s, e - s);
+            break;
+        }
+        out.append(s, bs - s);
+        s = bs + 1;
+        if (s >= e) break;
+        char c = *s++;
+        switch (c) {
+        case 'n': out += '\n'; break;
+        case 't': out += '\t'; break;
+        case 'r': out += '\r'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'u': {
+            unsigned cp;
+            if (!hex4(s, e, cp)) break;
+            s += 4;
+            // 代理对
+            unsigned lo;
+            if (cp >= 0xD800 && cp < 0xDC00 && e - s >= 6 && s[0] == '\\' && s[1] == 'u'
+                && hex4(s + 2, e, lo) && lo >= 0xDC00 && lo < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                s += 6;
+            }
+            appendUtf8(out, cp);
+            break;
+        }
+        default: out += c; break;   // \" \\ \/
+        }
+    }
+}
+
+long long JsonScanner::integer() const
+{
+    long long v = 0;
+    size_t i = 0;
+    bool neg = tokenLength > 0 && tokenStart[0] == '-';
+    if (neg) i++;
+    for (; i < tokenLength && tokenStart[i] >= '0' && tokenStart[i] <= '9'; i++)
+        v = v * 10 + (tokenStart[i] - '0');
+    return neg ? -v : v;
+}
+
+// ==========================================================
+// 应答字段提取
+// ==========================================================
+void AIResponseFields::clear()
+{
+    hasContent = false;
+    content.clear();
+    finishReason.clear();
+    hasError = false;
+    errorMessage.clear();
+    hasUsage = false;
+    promptTokens = completionTokens = cacheHitTokens = 0;
+    cacheMissTokens = -1;
+    toolCount = 0;
+}
+
+// 读取一个字符串值到 out；值为 null 或其他类型时跳过并返回 false
+static bool readString(JsonScanner& s, std::string& out, bool& ok)
+{
+    JsonScanner::Token t = s.next();
+    if (t == JsonScanner::String) {
+        s.decode(out);
+        return true;
+    }
+    ok = s.skip(t);
+    return false;
+}
+static long long readInteger(JsonScanner& s, bool& ok)
+{
+    JsonScanner::Token t = s.next();
+    if (t == JsonScanner::Number) return s.integer();
+    ok = s.skip(t);
+    return 0;
+}
+
+// tool_calls 数组
+static bool scanToolCalls(JsonScanner& s, AIResponseFields& f)
+{
+    JsonScanner::Token t = s.next();
+    if (t != JsonScanner::ArrayBegin) return s.skip(t);
+    bool ok = true;
+    while (ok && (t = s.next()) != JsonScanner::ArrayEnd) {
+        if (t != JsonScanner::ObjectBegin) {
+            ok = s.skip(t);
+            continue;
+        }
+        if (f.toolCount == (int)f.toolCalls.size()) f.toolCalls.emplace_back();
+        AIToolDelta& d = f.toolCalls[f.toolCount];
+        d.index = f.toolCount++;
+        d.id.clear();
+        d.name.clear();
+        d.arguments.clear();
+        while (ok && (t = s.next()) == JsonScanner::Key) {
+            if (s.is("index")) d.index = (int)readInteger(s, ok);
+            else if (s.is("id")) readString(s, d.id, ok);
+            else if (s.is("function")) {
+                if ((t = s.next()) != JsonScanner::ObjectBegin) {
+                    ok = s.skip(t);
+                    continue;
+                }
+                while (ok && (t = s.next()) == JsonScanner::Key) {
+                    if (s.is("name")) readString(s, d.name, ok);
+                    else if (s.is("arguments")) readString(s, d.arguments, ok);
+                    else ok = s.skipValue();
+                }
+                if (t != JsonScanner::ObjectEnd) ok = false;
+            }
+            else ok = s.skipValue();
+        }
+        if (t != JsonScanner::ObjectEnd) ok = false;
+    }
+    return ok;
+}
+
+// choices 数组：只看第一个元素
+static bool scanChoices(JsonScanner& s, AIResponseFields& f)
+{
+    JsonScanner::Token t = s.next();
+    if (t != JsonScanner::ArrayBegin) return s.skip(t);
+    bool ok = true;
+    bool first = true;
+    while (ok && (t = s.next()) != JsonScanner::ArrayEnd) {
+        if (t != JsonScanner::ObjectBegin || !first) {
+            ok = s.skip(t);
+            continue;
+        }
+        first = false;
+        while (ok && (t = s.next()) == JsonScanner::Key) {
+            if (s.is("delta") || s.is("message")) {
+                if ((t = s.next()) != JsonScanner::ObjectBegin) {
+                    ok = s.skip(t);
+                    continue;
+                }
+                while (ok && (t = s.next()) == JsonScanner::Key) {
+                    if (s.is("content")) f.hasContent = readString(s, f.content, ok);
+                    else if (s.is("tool_calls")) ok = scanToolCalls(s, f);
+                    else ok = s.skipValue();
+                }
+                if (t != JsonScanner::ObjectEnd) ok = false;
+            }
+            else if (s.is("finish_reason")) readString(s, f.finishReason, ok);
+            else ok = s.skipValue();
+        }
+        if (t != JsonScanner::ObjectEnd) ok = false;
+    }
+    return ok;
+}
+
+static bool scanUsage(JsonScanner& s, AIResponseFields& f)
+{
+    JsonScanner::Token t = s.next();
+    if (t != JsonScanner::ObjectBegin) return s.skip(t);
+    f.hasUsage = true;
+    bool ok = true;
+    while (ok && (t = s.next()) == JsonScanner::Key) {
+        if (s.is("prompt_tokens")) f.promptTokens = readInteger(s, ok);
+        else if (s.is("completion_tokens")) f.completionTokens = readInteger(s, ok);
+        else if (s.is("prompt_cache_hit_tokens")) f.cacheHitTokens = readInteger(s, ok);
+        else if (s.is("prompt_cache_miss_tokens")) f.cacheMissTokens = readInteger(s, ok);
+        else ok = s.skipValue();
+    }
+    return ok && t == JsonScanner::ObjectEnd;
+}
+
+static bool scanError(JsonScanner& s, AIResponseFields& f)
+{
+    JsonScanner::Token t = s.next();
+    f.hasError = true;
+    if (t == JsonScanner::String) {
+        s.decode(f.errorMessage);
+        return true;
+    }
+    if (t != JsonScanner::ObjectBegin) return s.skip(t);
+    bool ok = true;
+    while (ok && (t = s.next()) == JsonScanner::Key) {
+        if (s.is("message")) readString(s, f.errorMessage, ok);
+        else ok = s.skipValue();
+    }
+    return ok && t == JsonScanner::ObjectEnd;
+}
+
+bool scanResponse(const char* data, size_t len, AIResponseFields& f)
+{
+    f.clear();
+    JsonScanner s(data, len);
+    if (s.next() != JsonScanner::ObjectBegin) return false;
+    JsonScanner::Token t;
+    bool ok = true;
+    while (ok && (t = s.next()) == JsonScanner::Key) {
+        if (s.is("choices")) ok = scanChoices(s, f);
+        else if (s.is("usage")) ok = scanUsage(s, f);
+        else if (s.is("error")) ok = scanError(s, f);
+        else ok = s.skipValue();
+    }
+    return ok && t == JsonScanner::ObjectEnd;
+}
+
+// ==========================================================
+// 对比测试：同样的数据块分别用 scanResponse 与 jsoncpp 提取同样的字段
+// ==========================================================
+JsonBenchResult benchmarkJsonScan(int iterations)
+{
+    static const char* const chunks[] = {
+        u8"{\"id\":\"c1\",\"object\":\"chat.completion.chunk\",\"created\":1718345013,\"model\":\"deepseek-chat\","
+        u8"\"system_fingerprint\":\"fp_a49d71b8a1\",\"choices\":[{\"index\":0,\"delta\":{\"content\":\"读取 Q0.0 的状态\"},"
+        u8"\"logprobs\":null,\"finish_reason\":null}]}",
+        u8"{\"id\":\"c1\",\"object\":\"chat.completion.chunk\",\"created\":1718345013,\"model\":\"deepseek-chat\","
+        u8"\"system_fingerprint\":\"fp_a49d71b8a1\",\"choices\":[{\"index\":0,\"delta\":{\"content\":\"W: \\u5df2\\u6253\\u5f00\\n\\\"\"},"
+        u8"\"logprobs\":null,\"finish_reason\":null}]}",
+        u8"{\"id\":\"c1\",\"object\":\"chat.completion.chunk\",\"created\":1718345013,\"model\":\"deepseek-chat\","
+        u8"\"choices\":[{\"index\":0,\"delta\":{\"tool_calls\":[{\"index\":0,\"id\":\"call_0\",\"type\":\"function\","
+        u8"\"function\":{\"name\":\"read_tags\",\"arguments\":\"{\\\"addresses\\\":[\\\"Q0.0\\\"]}\"}}]},\"finish_reason\":null}]}",
+        u8"{\"id\":\"c1\",\"object\":\"chat.completion.chunk\",\"created\":1718345013,\"model\":\"deepseek-chat\","
+        u8"\"choices\":[],\"usage\":{\"prompt_tokens\":1234,\"completion_tokens\":56,\"total_tokens\":1290,"
+        u8"\"prompt_tokens_details\":{\"cached_tokens\":1152},\"prompt_cache_hit_tokens\":1152,\"prompt_cache_miss_tokens\":82}}",
+    };
+    const int count = sizeof(chunks) / sizeof(chunks[0]);
+    size_t lengths[count];
+    JsonBenchResult result;
+    result.iterations = iterations;
+    for (int i = 0; i < count; i++) {
+        lengths[i] = strlen(chunks[i]);
+        result.bytes += lengths[i];
+    }
+
+    using namespace std::chrono;
+    long long check = 0;   // 使用提取结果，避免被优化掉
+    AIResponseFields f;
+    auto t0 = steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < count; i++) {
+            scanResponse(chunks[i], lengths[i], f);
+            check += f.content.size() + f.promptTokens + f.toolCount;
+        }
+    }
+    auto t1 = steady_clock::now();
+
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string content, errors;
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < count; i++) {
+            Json::Value root;
+            reader->parse(chunks[i], chunks[i] + lengths[i], &root, &errors);
+            const Json::Value& delta = root["choices"][0]["delta"];
+            if (delta["content"].isString()) content = delta["content"].asString();
+            check += content.size() + root["usage"]["prompt_tokens"].asInt64() + delta["tool_calls"].size();
+        }
+    }
+    auto t2 = steady_clock::now();
+
+    if (iterations > 0 && check != 0) {
+        result.scanNs = duration<double, std::nano>(t1 - t0).count() / iterations;
+        result.jsoncppNs = duration<double, std::nano>(t2 - t1).count() / iterations;
+    }
+    return result;
+}
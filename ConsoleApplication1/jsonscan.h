@@ -0,0 +1,89 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// JsonScanner：拉取式 JSON 词法扫描器，直接在输入缓冲区上工作，不建立 DOM
+// 字符串只记录原始片段的位置，需要时用 decode 解码到调用者复用的 std::string 中
+class JsonScanner
+{
+public:
+    enum Token {
+        End,            // 输入结束
+        Error,          // 语法错误
+        ObjectBegin, ObjectEnd,
+        ArrayBegin, ArrayEnd,
+        Key,            // 对象中的键
+        String, Number, True, False, Null
+    };
+
+    JsonScanner(const char* data, size_t len);
+
+    Token next();
+    // 跳过一个完整的值：token 为 ObjectBegin / ArrayBegin 时跳到对应的结束位置
+    bool skip(Token token);
+    // 读取下一个值并跳过
+    bool skipValue();
+
+    // 当前 Key / String 是否等于 s（按原始片段比较）
+    bool is(const char* s) const;
+    // 把当前 Key / String 解码到 out（覆盖原内容，复用 out 的容量）
+    void decode(std::string& out) const;
+    // 当前 Number 的整数值
+    long long integer() const;
+
+    int depth() const { return level; }
+private:
+    const char* p;
+    const char* end;
+    const char* tokenStart = nullptr;
+    size_t tokenLength = 0;
+    bool escaped = false;           // 当前字符串是否含转义
+    bool expectKey = false;
+    static const int maxDepth = 64;
+    bool objectStack[maxDepth];     // 每层是否为对象
+    int level = 0;
+};
+
+// 一个工具调用片段（流式应答中的 delta.tool_calls[i]）
+struct AIToolDelta
+{
+    int index = 0;
+    std::string id;
+    std::string name;
+    std::string arguments;
+};
+
+// 从一个应答（SSE 数据块或完整应答）中提取的字段
+// 所有字符串在 clear 后保留容量，同一个对象反复使用时不再分配内存
+struct AIResponseFields
+{
+    bool hasContent = false;
+    std::string content;          // choices[0].delta.content 或 choices[0].message.content
+    std::string finishReason;     // choices[0].finish_reason
+    bool hasError = false;
+    std::string errorMessage;     // error.message
+    bool hasUsage = false;
+    long long promptTokens = 0;
+    long long completionTokens = 0;
+    long long cacheHitTokens = 0;
+    long long cacheMissTokens = -1;   // -1 表示应答中没有该字段
+    std::vector<AIToolDelta> toolCalls;   // 只有前 toolCount 个有效
+    int toolCount = 0;
+
+    void clear();
+};
+
+// 提取 choices[0].(delta|message).content / tool_calls、finish_reason、usage.*、error.message
+// 其余字段直接跳过；不是合法 JSON 对象时返回 false
+bool scanResponse(const char* data, size_t len, AIResponseFields& fields);
+
+// 与 jsoncpp 解析同样的字段对比耗时
+struct JsonBenchResult
+{
+    int iterations = 0;
+    size_t bytes = 0;          // 每轮解析的字节数
+    double scanNs = 0;         // 每轮耗时（纳秒）
+    double jsoncppNs = 0;
+};
+JsonBenchResult benchmarkJsonScan(int iterations);
@@ -0,0 +1,404 @@
+﻿#include "mockserver.h"
+#include <json/json.h>
+#include <chrono>
+#include <random>
+#include <cstring>
+
+// 把回复切成 token：非 ASCII 字符一个一个输出，ASCII 按单词最多 4 个字符一组
+static std::vector<std::string> splitTokens(const std::string& text)
+{
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char c = text[i];
+        size_t n = 1;
+        if (c >= 0x80) {
+            n = (c >> 5) == 0x06 ? 2 : (c >> 4) == 0x0E ? 3 : (c >> 3) == 0x1E ? 4 : 1;
+        }
+        else {
+            while (n < 4 && i + n < text.size()) {
+                unsigned char d = text[i + n];
+                if (d >= 0x80 || d == ' ' || d == '\n') break;
+                n++;
+            }
+        }
+        if (i + n > text.size()) n = text.size() - i;
+        tokens.push_back(text.substr(i, n));
+        i += n;
+    }
+    return tokens;
+}
+static std::string toJson(const Json::Value& v)
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, v);
+}
+static const char* statusText(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default:  return "Error";
+    }
+}
+static bool sendText(NetSocket s, const std::string& text)
+{
+    return netSendAll(s, text.data(), text.size());
+}
+// 分块传输编码的一块
+static bool sendChunk(NetSocket s, const std::string& data)
+{
+    char size[16];
+    int n = snprintf(size, sizeof(size), "%zx\r\n", data.size());
+    return netSendAll(s, size, n) && sendText(s, data + "\r\n");
+}
+static bool sendResponse(NetSocket s, int status, const std::string& body, const std::string& extraHeaders = "")
+{
+    std::string resp = "HTTP/1.1 " + std::to_string(status) + " " + statusText(status) + "\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n" + extraHeaders + "\r\n" + body;
+    return sendText(s, resp);
+}
+
+MockAIServer::MockAIServer()
+    : listener(NET_INVALID), port(0), running(false), requests(0)
+{
+}
+MockAIServer::~MockAIServer()
+{
+    stop();
+}
+bool MockAIServer::start(int listenPort)
+{
+    if (running) return true;
+    netInit();
+    port = listenPort;
+    listener = netListen("127.0.0.1", port);
+    if (listener == NET_INVALID) return false;
+    running = true;
+    acceptThread = std::thread(&MockAIServer::acceptLoop, this);
+    return true;
+}
+void MockAIServer::stop()
+{
+    if (!running) return;
+    running = false;
+    netShutdown(listener);
+    netClose(listener);
+    listener = NET_INVALID;
+    if (acceptThread.joinable()) acceptThread.join();
+
+    // 在锁外等待连接线程：线程结束前要取得锁关闭自己的套接字
+    std::list<Worker> all;
+    {
+        std::lock_guard<std::mutex> g(clientLock);
+        all.swap(workers);
+        for (Worker& w : all)
+            if (!w.done) netShutdown(w.socket);
+    }
+    for (Worker& w : all)
+        if (w.thread.joinable()) w.thread.join();
+}
+bool MockAIServer::isRunning() const
+{
+    return running;
+}
+int MockAIServer::getPort() const
+{
+    return port;
+}
+std::string MockAIServer::getEndpoint() const
+{
+    return "http://127.0.0.1:" + std::to_string(port) + "/v1/chat/completions";
+}
+void MockAIServer::setConfig(const MockAIConfig& cfg)
+{
+    std::lock_guard<std::mutex> g(lock);
+    config = cfg;
+}
+MockAIConfig MockAIServer::getConfig()
+{
+    std::lock_guard<std::mutex> g(lock);
+    return config;
+}
+void MockAIServer::addReply(const std::string& match, const std::string& reply)
+{
+    std::lock_guard<std::mutex> g(lock);
+    scripts.push_back({ match, reply });
+}
+void MockAIServer::addToolReply(const std::string& match, const std::string& function, const std::string& arguments,
+    int step)
+{
+    std::lock_guard<std::mutex> g(lock);
+    toolScripts.push_back({ match, function, arguments, step });
+}
+void MockAIServer::setDefaultReply(const std::string& reply)
+{
+    std::lock_guard<std::mutex> g(lock);
+    defaultReply = reply;
+}
+void MockAIServer::clearReplies()
+{
+    std::lock_guard<std::mutex> g(lock);
+    scripts.clear();
+    toolScripts.clear();
+    defaultReply.clear();
+}
+long long MockAIServer::requestCount() const
+{
+    return requests;
+}
+void MockAIServer::acceptLoop()
+{
+    while (running) {
+        NetSocket s = netAccept(listener);
+        if (s == NET_INVALID) continue;
+        std::lock_guard<std::mutex> g(clientLock);
+        if (!running) {
+            netClose(s);
+            break;
+        }
+        netNoDelay(s);
+        reapWorkers();
+        workers.push_back({ std::thread(), s, false });
+        Worker* w = &workers.back();
+        w->thread = std::thread(&MockAIServer::serve, this, w);
+    }
+}
+void MockAIServer::reapWorkers()
+{
+    for (auto it = workers.begin(); it != workers.end();) {
+        if (!it->done) {
+            ++it;
+            continue;
+        }
+        if (it->thread.joinable()) it->thread.join();
+        it = workers.erase(it);
+    }
+}
+void MockAIServer::serve(Worker* w)
+{
+    serveConnection(w->socket);
+    std::lock_guard<std::mutex> g(clientLock);
+    netClose(w->socket);
+    w->done = true;
+}
+// HTTP/1.1 长连接：循环读取请求头与 Content-Length 指定的请求体
+void MockAIServer::serveConnection(NetSocket s)
+{
+    std::string buffer;
+    char chunk[4096];
+    while (running) {
+        size_t headEnd;
+        while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+            int n = netRecv(s, chunk, sizeof(chunk));
+            if (n <= 0) return;
+            buffer.append(chunk, n);
+        }
+
+        std::string head = buffer.substr(0, headEnd);
+        size_t contentLength = 0;
+        bool close = false;
+        size_t pos = head.find("\r\n");
+        std::string requestLine = head.substr(0, pos);
+        while (pos != std::string::npos && pos < head.size()) {
+            size_t next = head.find("\r\n", pos + 2);
+            std::string line = head.substr(pos + 2, next == std::string::npos ? std::string::npos : next - pos - 2);
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                std::string name = line.substr(0, colon);
+                for (char& c : name) c = (char)tolower((unsigned char)c);
+                std::string value = line.substr(colon + 1);
+                while (!value.empty() && value[0] == ' ') value.erase(0, 1);
+                if (name == "content-length") contentLength = (size_t)atoll(value.c_str());
+                else if (name == "connection" && (value == "close" || value == "Close")) close = true;
+            }
+            pos = next;
+        }
+
+        while (buffer.size() < headEnd + 4 + contentLength) {
+            int n = netRecv(s, chunk, sizeof(chunk));
+            if (n <= 0) return;
+            buffer.append(chunk, n);
+        }
+        std::string body = buffer.substr(headEnd + 4, contentLength);
+        buffer.erase(0, headEnd + 4 + contentLength);
+
+        // 请求行：POST /v1/chat/completions HTTP/1.1
+        size_t sp1 = requestLine.find(' ');
+        size_t sp2 = requestLine.find(' ', sp1 + 1);
+        std::string method = requestLine.substr(0, sp1);
+        std::string path = sp1 == std::string::npos ? "" : requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+        requests++;
+        if (method != "POST") {
+            if (!sendResponse(s, 404, "{\"error\":{\"message\":\"not found\"}}")) return;
+            continue;
+        }
+        if (!handle(s, path, body) || close) return;
+    }
+}
+
+bool MockAIServer::handle(NetSocket s, const std::string& path, const std::string& body)
+{
+    using namespace std::chrono;
+    if (path != "/v1/chat/completions" && path != "/chat/completions")
+        return sendResponse(s, 404, "{\"error\":{\"message\":\"not found\"}}");
+
+    Json::Value req;
+    Json::CharReaderBuilder reader;
+    std::string errors;
+    std::unique_ptr<Json::CharReader> r(reader.newCharReader());
+    if (!r->parse(body.data(), body.data() + body.size(), &req, &errors) || !req["messages"].isArray())
+        return sendResponse(s, 400, "{\"error\":{\"message\":\"invalid request body\"}}");
+
+    // 最后一条用户消息；最后一条是工具结果时收集本轮所有结果
+    // step 为用户消息之后已经发出的工具调用步数
+    std::string user, toolResults;
+    int step = 0;
+    const Json::Value& messages = req["messages"];
+    for (int i = (int)messages.size() - 1; i >= 0; i--) {
+        if (messages[i]["role"].asString() == "user") {
+            user = messages[i]["content"].asString();
+            break;
+        }
+        if (messages[i]["tool_calls"].isArray() && messages[i]["tool_calls"].size() > 0)
+            step++;
+    }
+    for (int i = (int)messages.size() - 1; i >= 0 && messages[i]["role"].asString() == "tool"; i--)
+        toolResults = messages[i]["content"].asString() + (toolResults.empty() ? "" : "\n") + toolResults;
+    bool hasTools = req["tools"].isArray() && req["tools"].size() > 0;
+
+    MockAIConfig cfg;
+    std::string reply;
+    Json::Value toolCalls(Json::arrayValue);
+    long long hitTokens;
+    bool fail;
+    {
+        std::lock_guard<std::mutex> g(lock);
+        cfg = config;
+        if (hasTools) {
+            // 匹配的当前步骤的工具脚本都作为同一步的调用返回
+            for (auto& ts : toolScripts) {
+                if (ts.step != step || user.find(ts.match) == std::string::npos) continue;
+                Json::Value call;
+                call["id"] = "call_" + std::to_string(requests.load()) + "_" + std::to_string(toolCalls.size());
+                call["type"] = "function";
+                call["function"]["name"] = ts.function;
+                call["function"]["arguments"] = ts.arguments;
+                toolCalls.append(call);
+            }
+        }
+        if (toolCalls.empty() && !toolResults.empty())
+            reply = u8"W: 执行结果 " + toolResults + "\nC: none";
+        for (auto& sc : scripts) {
+            if (!reply.empty() || !toolCalls.empty()) break;
+            if (user.find(sc.match) != std::string::npos) {
+                reply = sc.reply;
+                break;
+            }
+        }
+        if (reply.empty() && toolCalls.empty())
+            reply = defaultReply.empty() ? user : defaultReply;
+
+        // 与上一个请求的公共前缀按 64 token 为单位计为缓存命中（约 4 字节 / token）
+        size_t common = 0;
+        while (common < body.size() && common < lastBody.size() && body[common] == lastBody[common]) common++;
+        hitTokens = (long long)(common / 4) / 64 * 64;
+        lastBody = body;
+
+        static std::mt19937 rng(12345);
+        fail = (cfg.failEvery > 0 && requests % cfg.failEvery == 0)
+            || (cfg.errorRate > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < cfg.errorRate);
+    }
+
+    if (fail) {
+        std::this_thread::sleep_for(milliseconds(cfg.firstTokenMs / 2));
+        return sendResponse(s, cfg.errorStatus, "{\"error\":{\"message\":\"mock injected error\",\"type\":\"mock\"}}",
+            cfg.errorStatus == 429 ? "Retry-After: 1\r\n" : "");
+    }
+
+    std::vector<std::string> tokens = splitTokens(reply);
+    Json::Value usage;
+    long long promptTokens = (long long)body.size() / 4;
+    usage["prompt_tokens"] = (Json::Int64)promptTokens;
+    long long completionTokens = (long long)tokens.size() + (long long)toJson(toolCalls).size() / 4;
+    usage["completion_tokens"] = (Json::Int64)completionTokens;
+    usage["total_tokens"] = (Json::Int64)(promptTokens + completionTokens);
+    usage["prompt_cache_hit_tokens"] = (Json::Int64)hitTokens;
+    usage["prompt_cache_miss_tokens"] = (Json::Int64)(promptTokens - hitTokens);
+
+    // 按绝对时间表发送，避免逐个 sleep 累积误差
+    auto t0 = steady_clock::now();
+    auto tokenTime = [&](size_t i) {
+        double ms = cfg.firstTokenMs + (cfg.tokensPerSec > 0 ? i * 1000.0 / cfg.tokensPerSec : 0);
+        return t0 + microseconds((long long)(ms * 1000));
+    };
+
+    if (!req["stream"].asBool()) {
+        std::this_thread::sleep_until(tokenTime(tokens.empty() ? 0 : tokens.size() - 1));
+        Json::Value resp;
+        resp["id"] = "mock-" + std::to_string(requests.load());
+        resp["object"] = "chat.completion";
+        resp["model"] = req["model"];
+        resp["choices"][0]["index"] = 0;
+        resp["choices"][0]["message"]["role"] = "assistant";
+        resp["choices"][0]["message"]["content"] = reply;
+        if (!toolCalls.empty())
+            resp["choices"][0]["message"]["tool_calls"] = toolCalls;
+        resp["choices"][0]["finish_reason"] = toolCalls.empty() ? "stop" : "tool_calls";
+        resp["usage"] = usage;
+        return sendResponse(s, 200, toJson(resp));
+    }
+
+    // SSE：分块传输，每个 token 一个事件
+    if (!sendText(s, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\nTransfer-Encoding: chunked\r\n\r\n"))
+        return false;
+
+    Json::Value ev;
+    ev["id"] = "mock-" + std::to_string(requests.load());
+    ev["object"] = "chat.completion.chunk";
+    ev["model"] = req["model"];
+    ev["choices"][0]["index"] = 0;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        std::this_thread::sleep_until(tokenTime(i));
+        ev["choices"][0]["delta"]["content"] = tokens[i];
+        if (!sendChunk(s, "data: " + toJson(ev) + "\n\n")) return false;
+    }
+    // 工具调用：首个数据块带 id 与函数名，参数分两块发送（与真实接口一样需要按 index 拼接）
+    for (Json::ArrayIndex i = 0; i < toolCalls.size(); i++) {
+        std::this_thread::sleep_until(tokenTime(tokens.size() + i));
+        std::string args = toolCalls[i]["function"]["arguments"].asString();
+        size_t half = args.size() / 2;
+        while (half < args.size() && ((unsigned char)args[half] & 0xC0) == 0x80) half++;
+        Json::Value call = toolCalls[i];
+        call["index"] = (int)i;
+        call["function"]["arguments"] = args.substr(0, half);
+        ev["choices"][0]["delta"] = Json::Value(Json::objectValue);
+        ev["choices"][0]["delta"]["tool_calls"][0] = call;
+        if (!sendChunk(s, "data: " + toJson(ev) + "\n\n")) return false;
+        Json::Value rest;
+        rest["index"] = (int)i;
+        rest["function"]["arguments"] = args.substr(half);
+        ev["choices"][0]["delta"]["tool_calls"][0] = rest;
+        if (!sendChunk(s, "data: " + toJson(ev) + "\n\n")) return false;
+    }
+
+    ev["choices"][0]["delta"] = Json::Value(Json::objectValue);
+    ev["choices"][0]["finish_reason"] = toolCalls.empty() ? "stop" : "tool_calls";
+    if (!sendChunk(s, "data: " + toJson(ev) + "\n\n")) return false;
+    if (req["stream_options"]["include_usage"].asBool()) {
+        Json::Value last;
+        last["id"] = ev["id"];
+        last["object"] = "chat.completion.chunk";
+        last["choices"] = Json::Value(Json::arrayValue);
+        last["usage"] = usage;
+        if (!sendChunk(s, "data: " + toJson(last) + "\n\n")) return false;
+    }
+    return sendChunk(s, "data: [DONE]\n\n") && sendText(s, "0\r\n\r\n");
+}
@@ -0,0 +1,81 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include "netsock.h"
+
+// 模拟参数
+struct MockAIConfig
+{
+    int firstTokenMs = 300;       // 首个 token 延迟（毫秒）
+    double tokensPerSec = 50;     // 输出速度，<= 0 表示一次性输出
+    double errorRate = 0;         // 随机返回错误的概率（0~1）
+    int failEvery = 0;            // 每 N 个请求返回一次错误，0 不启用
+    int errorStatus = 500;        // 注入错误使用的 HTTP 状态码（429 时附带 Retry-After）
+};
+
+// MockAIServer：本地 DeepSeek 接口替身，用于离线调试与压测 DeepSeekAI
+// 实现 POST /v1/chat/completions，支持 stream=true（SSE）与非流式两种应答
+// 回复按最后一条用户消息匹配脚本；请求带 tools 时可按脚本返回 tool_calls，
+// 最后一条是工具结果时回复一段包含结果的文本，usage 中按与上一个请求的公共前缀模拟上下文缓存命中
+// 每个连接一个线程，支持 HTTP/1.1 长连接
+class MockAIServer
+{
+public:
+    MockAIServer();
+    ~MockAIServer();
+
+    // 在 127.0.0.1 上启动监听，port 为 0 时由系统分配
+    bool start(int port = 0);
+    void stop();
+    bool isRunning() const;
+    int getPort() const;
+    // 完整接口地址，可直接传给 DeepSeekAI::setEndpoint
+    std::string getEndpoint() const;
+
+    void setConfig(const MockAIConfig& config);
+    MockAIConfig getConfig();
+
+    // 脚本回复：用户消息包含 match 时返回 reply，按添加顺序匹配
+    void addReply(const std::string& match, const std::string& reply);
+    // 工具调用脚本：请求带 tools 且用户消息包含 match 时，调用 function 函数，参数为 arguments（JSON 文本）
+    // step 为该用户消息之后的第几步调用（0 为第一步），用于模拟多步查询；没有对应步骤的脚本时回复工具结果
+    void addToolReply(const std::string& match, const std::string& function, const std::string& arguments,
+        int step = 0);
+    // 没有匹配时的回复，为空时回显用户消息
+    void setDefaultReply(const std::string& reply);
+    void clearReplies();
+
+    // 已处理的请求数
+    long long requestCount() const;
+private:
+    struct Script { std::string match; std::string reply; };
+    std::vector<Script> scripts;
+    struct ToolScript { std::string match; std::string function; std::string arguments; int step; };
+    std::vector<ToolScript> toolScripts;
+    std::string defaultReply;
+    MockAIConfig config;
+    std::string lastBody;             // 上一个请求体，用于模拟前缀缓存
+    std::mutex lock;                  // 保护以上数据
+
+    NetSocket listener;
+    int port;
+    std::atomic<bool> running;
+    std::atomic<long long> requests;
+    std::thread acceptThread;
+    // 每个连接一个线程；连接结束时线程自己关闭套接字并标记 done，接受新连接时回收
+    struct Worker { std::thread thread; NetSocket socket; bool done; };
+    std::list<Worker> workers;
+    std::mutex clientLock;            // 保护 workers
+
+    void acceptLoop();
+    // 在持有 clientLock 时调用：回收已结束的连接线程
+    void reapWorkers();
+    void serve(Worker* w);
+    void serveConnection(NetSocket s);
+    // 处理一个请求，返回 false 表示连接应关闭
+    bool handle(NetSocket s, const std::string& path, const std::string& body);
+};
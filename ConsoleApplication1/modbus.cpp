@@ -0,0 +1,356 @@
+﻿#include "modbus.h"
+#include <algorithm>
+#include <cstring>
+
+// 单帧上限：读 125 个寄存器 / 2000 个线圈，写 123 个寄存器 / 1968 个线圈，换算成字节映像
+const int maxReadBytes = 250;
+const int maxWriteBytes = 246;
+
+static bool isRegisterArea(int area)
+{
+    return area == MBAreaHoldingRegs || area == MBAreaInputRegs;
+}
+static bool isModbusArea(int area)
+{
+    return area >= MBAreaCoils && area <= MBAreaInputRegs;
+}
+static void put16(uint8_t* p, int v)
+{
+    p[0] = (v >> 8) & 0xFF;
+    p[1] = v & 0xFF;
+}
+
+ModbusBackend::ModbusBackend()
+{
+    sock = NET_INVALID;
+    connected = false;
+    unitId = 1;
+    nextTid = 1;
+    timeoutMs = 1000;
+    maxGap = 16;
+    maxInFlight = 8;
+}
+ModbusBackend::~ModbusBackend()
+{
+    disconnect();
+}
+bool ModbusBackend::connect(const std::string& address, int, int)
+{
+    std::lock_guard<std::mutex> g(lock);
+    if (connected) fail();
+
+    // 拆分 ip[:port][/unit]
+    std::string host = address;
+    int port = 502;
+    size_t slash = host.find('/');
+    if (slash != std::string::npos) {
+        unitId = (uint8_t)atoi(host.c_str() + slash + 1);
+        host = host.substr(0, slash);
+    }
+    size_t colon = host.find(':');
+    if (colon != std::string::npos) {
+        port = atoi(host.c_str() + colon + 1);
+        host = host.substr(0, colon);
+    }
+
+    sock = netConnect(host, port, timeoutMs);
+    connected = sock != NET_INVALID;
+    return connected;
+}
+void ModbusBackend::disconnect()
+{
+    std::lock_guard<std::mutex> g(lock);
+    fail();
+}
+bool ModbusBackend::isConnected() const
+{
+    return connected;
+}
+void ModbusBackend::setTimeout(int ms)
+{
+    timeoutMs = ms;
+    if (connected) netSetTimeout(sock, ms);
+}
+void ModbusBackend::setMaxGap(int bytes)
+{
+    maxGap = bytes;
+}
+void ModbusBackend::setMaxInFlight(int n)
+{
+    maxInFlight = n > 0 ? n : 1;
+}
+// 网络出错后流水线已无法对齐，直接断开
+void ModbusBackend::fail()
+{
+    netClose(sock);
+    sock = NET_INVALID;
+    connected = false;
+}
+int ModbusBackend::pipeline(Transaction* txns, int count)
+{
+    if (!connected) return plcErrNotConnected;
+    int sent = 0, done = 0, firstError = 0;
+    uint8_t frame[7 + 256];
+
+    while (done < count) {
+        // 保持 maxInFlight 个请求在途
+        while (sent < count && sent - done < maxInFlight) {
+            Transaction& t = txns[sent];
+            t.tid = nextTid++;
+            t.result = plcErrIO;
+            put16(frame, t.tid);
+            put16(frame + 2, 0);              // 协议号
+            put16(frame + 4, t.pduLen + 1);   // 后续长度（含站号）
+            frame[6] = unitId;
+            memcpy(frame + 7, t.pdu, t.pduLen);
+            if (!netSendAll(sock, frame, 7 + t.pduLen)) {
+                fail();
+                return plcErrIO;
+            }
+            sent++;
+        }
+
+        // 收一帧应答：MBAP 头 7 字节 + PDU
+        uint8_t head[7];
+        if (!netRecvAll(sock, head, 7)) {
+            fail();
+            return plcErrIO;
+        }
+        uint16_t tid = (head[0] << 8) | head[1];
+        int len = ((head[4] << 8) | head[5]) - 1;
+        if (len <= 0 || len > 253 || !netRecvAll(sock, frame, len)) {
+            fail();
+            return plcErrIO;
+        }
+
+        // 按事务号找到对应请求（设备可能乱序应答）
+        Transaction* t = nullptr;
+        for (int i = done; i < sent; i++)
+            if (txns[i].tid == tid) t = &txns[i];
+        if (!t) {
+            fail();
+            return plcErrProtocol;
+        }
+
+        if (frame[0] == (t->pdu[0] | 0x80))
+            t->result = plcErrDevice;          // 异常应答
+        else if (frame[0] != t->pdu[0])
+            t->result = plcErrProtocol;
+        else if (t->out) {
+            if (len < 2 || frame[1] != t->outLen || len - 2 < t->outLen)
+                t->result = plcErrProtocol;
+            else {
+                memcpy(t->out, frame + 2 + t->skip, t->keep);
+                t->result = 0;
+            }
+        }
+        else
+            t->result = 0;
+        if (t->result != 0 && firstError == 0) firstError = t->result;
+
+        // 已完成的请求移到前面，保持 [done, sent) 为在途区间
+        std::swap(*t, txns[done]);
+        done++;
+    }
+    return firstError;
+}
+int ModbusBackend::readRanges(const Range* list, int count)
+{
+    batch.clear();
+    for (int i = 0; i < count; i++) {
+        const Range& r = list[i];
+        // 寄存器区按 2 字节对齐
+        bool reg = isRegisterArea(r.area);
+        int s = reg ? r.start & ~1 : r.start;
+        int e = reg ? (r.end + 1) & ~1 : r.end;
+        for (int off = s; off < e; off += maxReadBytes) {
+            int n = std::min(maxReadBytes, e - off);
+            Transaction t;
+            t.pdu[0] = (uint8_t)r.area;        // 区域代码即读功能码 1~4
+            if (reg) {
+                put16(t.pdu + 1, off / 2);
+                put16(t.pdu + 3, n / 2);
+            }
+            else {
+                put16(t.pdu + 1, off * 8);
+                put16(t.pdu + 3, n * 8);
+            }
+            t.pduLen = 5;
+            int lo = std::max(off, r.start);
+            int hi = std::min(off + n, r.end);
+            t.out = r.out + (lo - r.start);
+            t.outLen = n;
+            t.skip = lo - off;
+            t.keep = hi - lo;
+            batch.push_back(t);
+        }
+    }
+    return pipeline(batch.data(), (int)batch.size());
+}
+int ModbusBackend::readArea(int area, int, int start, int size, uint8_t* buffer)
+{
+    if (!isModbusArea(area) || start < 0 || size <= 0) return plcErrNotSupported;
+    std::lock_guard<std::mutex> g(lock);
+
+    Range r;
+    r.area = area;
+    r.start = start;
+    r.end = start + size;
+    r.out = buffer;
+    return readRanges(&r, 1);
+}
+// 按区域、起始地址排序后合并相邻的读取项
+int ModbusBackend::readMulti(PLCDataItem* items, int count)
+{
+    std::lock_guard<std::mutex> g(lock);
+    itemOrder.clear();
+    for (int i = 0; i < count; i++) {
+        if (isModbusArea(items[i].area) && items[i].start >= 0 && items[i].size > 0)
+            itemOrder.push_back(i);
+        else
+            items[i].result = plcErrNotSupported;
+    }
+    std::sort(itemOrder.begin(), itemOrder.end(), [&](int a, int b) {
+        if (items[a].area != items[b].area) return items[a].area < items[b].area;
+        return items[a].start < items[b].start;
+    });
+
+    ranges.clear();
+    itemRange.assign(count, -1);
+    for (int i : itemOrder) {
+        PLCDataItem& it = items[i];
+        bool reg = isRegisterArea(it.area);
+        int s = reg ? it.start & ~1 : it.start;
+        int e = reg ? (it.start + it.size + 1) & ~1 : it.start + it.size;
+        if (!ranges.empty()) {
+            Range& last = ranges.back();
+            if (last.area == it.area && s <= last.end + maxGap
+                && std::max(e, last.end) - last.start <= maxReadBytes) {
+                last.end = std::max(e, last.end);
+                itemRange[i] = (int)ranges.size() - 1;
+                continue;
+            }
+        }
+        Range r;
+        r.area = it.area;
+        r.start = s;
+        r.end = e;
+        ranges.push_back(r);
+        itemRange[i] = (int)ranges.size() - 1;
+    }
+
+    // 合并区间含空隙，先读到复用的缓冲里再分发给各项
+    size_t total = 0;
+    for (Range& r : ranges)
+        total += r.end - r.start;
+    if (rangeData.size() < total)
+        rangeData.resize(total);
+    total = 0;
+    for (Range& r : ranges) {
+        r.out = rangeData.data() + total;
+        total += r.end - r.start;
+    }
+    int result = readRanges(ranges.data(), (int)ranges.size());
+
+    // 单帧失败时无法确定属于哪一项，整批按同一结果返回
+    int firstError = 0;
+    for (int i = 0; i < count; i++) {
+        PLCDataItem& it = items[i];
+        if (itemRange[i] >= 0) {
+            it.result = result;
+            if (result == 0) {
+                Range& r = ranges[itemRange[i]];
+                memcpy(it.data, r.out + (it.start - r.start), it.size);
+            }
+        }
+        if (it.result != 0 && firstError == 0) firstError = it.result;
+    }
+    return firstError;
+}
+int ModbusBackend::writeRegion(int area, int start, int size, const uint8_t* buffer, const uint8_t* edge)
+{
+    int end = start + size;
+    int s = area == MBAreaCoils ? start : start & ~1;
+    int e = area == MBAreaCoils ? end : (end + 1) & ~1;
+    batch.clear();
+    for (int off = s; off < e; off += maxWriteBytes) {
+        int n = std::min(maxWriteBytes, e - off);
+        Transaction t;
+        if (area == MBAreaCoils) {
+            t.pdu[0] = 15;                     // 写多个线圈
+            put16(t.pdu + 1, off * 8);
+            put16(t.pdu + 3, n * 8);
+        }
+        else {
+            t.pdu[0] = 16;                     // 写多个寄存器
+            put16(t.pdu + 1, off / 2);
+            put16(t.pdu + 3, n / 2);
+        }
+        t.pdu[5] = (uint8_t)n;
+        int lo = std::max(off, start);
+        int hi = std::min(off + n, end);
+        memcpy(t.pdu + 6 + (lo - off), buffer + (lo - start), hi - lo);
+        // 首尾寄存器中不属于本次写入的字节用读回的原值填上
+        if (off < start) t.pdu[6] = edge[0];
+        if (off + n > end) t.pdu[6 + n - 1] = edge[1];
+        t.pduLen = 6 + n;
+        t.out = nullptr;
+        t.outLen = 0;
+        batch.push_back(t);
+    }
+    return pipeline(batch.data(), (int)batch.size());
+}
+int ModbusBackend::writeArea(int area, int, int start, int size, const uint8_t* buffer)
+{
+    if (area != MBAreaCoils && area != MBAreaHoldingRegs) return plcErrNotSupported;
+    if (start < 0 || size <= 0) return plcErrOutOfRange;
+    std::lock_guard<std::mutex> g(lock);
+
+    int end = start + size;
+    if (area == MBAreaCoils || ((start | end) & 1) == 0)
+        return writeRegion(area, start, size, buffer, nullptr);
+
+    // 未按寄存器对齐：只读回首尾寄存器里相邻的那个字节，拼进写请求
+    uint8_t edge[2] = { 0, 0 };
+    Range r[2];
+    int n = 0;
+    if (start & 1)
+        r[n++] = { area, start - 1, start, edge };
+    if (end & 1)
+        r[n++] = { area, end, end + 1, edge + 1 };
+    int result = readRanges(r, n);
+    if (result != 0) return result;
+    return writeRegion(area, start, size, buffer, edge);
+}
+int ModbusBackend::writeBit(int area, int dbNumber, int start, int bit, bool value)
+{
+    if (area != MBAreaCoils && area != MBAreaHoldingRegs) return plcErrNotSupported;
+    Transaction t;
+    if (area == MBAreaCoils) {
+        t.pdu[0] = 5;                          // 写单个线圈
+        put16(t.pdu + 1, start * 8 + bit);
+        put16(t.pdu + 3, value ? 0xFF00 : 0x0000);
+        t.pduLen = 5;
+    }
+    else {
+        // 掩码写寄存器：偶数字节是寄存器高 8 位
+        int mask = 1 << ((start % 2 == 0 ? 8 : 0) + bit);
+        t.pdu[0] = 22;
+        put16(t.pdu + 1, start / 2);
+        put16(t.pdu + 3, ~mask & 0xFFFF);
+        put16(t.pdu + 5, value ? mask : 0);
+        t.pduLen = 7;
+    }
+    t.out = nullptr;
+    t.outLen = 0;
+
+    int result;
+    {
+        std::lock_guard<std::mutex> g(lock);
+        result = pipeline(&t, 1);
+    }
+    // 设备不支持功能码 22 时退回读改写
+    if (result == plcErrDevice && area == MBAreaHoldingRegs)
+        return PLCBackend::writeBit(area, dbNumber, start, bit, value);
+    return result;
+}
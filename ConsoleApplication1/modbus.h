@@ -0,0 +1,77 @@
+﻿#pragma once
+#include <mutex>
+#include <vector>
+#include "plcbackend.h"
+#include "netsock.h"
+
+// ModbusBackend：Modbus TCP 客户端后端
+// 地址模型与 PLCClient 一致：四张表都按字节映像访问（见 MBArea* 的说明）
+// 批量读取会把相邻地址合并成尽量大的寄存器 / 线圈区间，多个请求以不同的事务号流水线发送
+class ModbusBackend : public PLCBackend
+{
+public:
+    ModbusBackend();
+    ~ModbusBackend();
+
+    // address 格式：ip[:port][/unit]，默认端口 502、站号 1；rack / slot 不使用
+    bool connect(const std::string& address, int rack, int slot) override;
+    void disconnect() override;
+    bool isConnected() const override;
+
+    int readArea(int area, int dbNumber, int start, int size, uint8_t* buffer) override;
+    int writeArea(int area, int dbNumber, int start, int size, const uint8_t* buffer) override;
+    int writeBit(int area, int dbNumber, int start, int bit, bool value) override;
+    int readMulti(PLCDataItem* items, int count) override;
+
+    // 收发超时（毫秒）
+    void setTimeout(int ms);
+    // 合并读取时允许跨越的最大空隙（字节映像中的字节数）
+    void setMaxGap(int bytes);
+    // 流水线中同时在途的最大请求数
+    void setMaxInFlight(int n);
+private:
+    // 一次 Modbus 事务
+    struct Transaction
+    {
+        uint8_t pdu[256];     // 请求 PDU（功能码 + 数据）
+        int pduLen;
+        uint8_t* out;         // 读请求的数据输出位置
+        int outLen;           // 期望的数据字节数
+        int skip;             // 应答数据中丢弃的前导字节（寄存器对齐多读的部分）
+        int keep;             // 复制到 out 的字节数
+        uint16_t tid;         // 事务号
+        int result;
+    };
+    // 读取区间（字节映像 [start, end)），数据直接写到 out；寄存器区对齐多出的字节在应答中丢弃
+    struct Range
+    {
+        int area;
+        int start;
+        int end;
+        uint8_t* out;
+    };
+
+    NetSocket sock;
+    bool connected;
+    uint8_t unitId;
+    uint16_t nextTid;
+    int timeoutMs;
+    int maxGap;
+    int maxInFlight;
+    std::mutex lock;      // 一个连接上同一时间只跑一组事务
+
+    // 以下缓冲在锁内复用，稳定运行后读写不再分配内存
+    std::vector<Transaction> batch;
+    std::vector<Range> ranges;
+    std::vector<int> itemOrder;
+    std::vector<int> itemRange;
+    std::vector<uint8_t> rangeData;   // readMulti 合并区间的数据
+
+    // 流水线执行一组事务，返回第一个错误
+    int pipeline(Transaction* txns, int count);
+    // 把若干区间拆成不超过单帧上限的读事务并执行（需持锁）
+    int readRanges(const Range* list, int count);
+    // 写连续区域（需持锁）；寄存器区未对齐时 edge 给出首尾寄存器中不属于本次写入的那两个字节
+    int writeRegion(int area, int start, int size, const uint8_t* buffer, const uint8_t* edge);
+    void fail();
+};
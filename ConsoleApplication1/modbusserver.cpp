@@ -0,0 +1,221 @@
+﻿#include "modbusserver.h"
+#include <chrono>
+#include <cstring>
+
+const int tableSize = 65536;
+
+static int get16(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+static void put16(uint8_t* p, int v)
+{
+    p[0] = (v >> 8) & 0xFF;
+    p[1] = v & 0xFF;
+}
+// 异常应答
+static int exception(uint8_t fc, uint8_t code, uint8_t* resp)
+{
+    resp[0] = fc | 0x80;
+    resp[1] = code;
+    return 2;
+}
+
+ModbusServer::ModbusServer()
+    : coils(tableSize, 0), discrete(tableSize, 0), holding(tableSize, 0), input(tableSize, 0),
+      listener(NET_INVALID), port(0), running(false), loopback(false), delayMs(0), requests(0)
+{
+}
+ModbusServer::~ModbusServer()
+{
+    stop();
+}
+bool ModbusServer::start(int listenPort)
+{
+    if (running) return true;
+    port = listenPort;
+    listener = netListen("127.0.0.1", port);
+    if (listener == NET_INVALID) return false;
+    running = true;
+    acceptThread = std::thread(&ModbusServer::acceptLoop, this);
+    return true;
+}
+void ModbusServer::stop()
+{
+    if (!running) return;
+    running = false;
+    netShutdown(listener);
+    netClose(listener);
+    listener = NET_INVALID;
+    if (acceptThread.joinable()) acceptThread.join();
+
+    std::lock_guard<std::mutex> g(clientLock);
+    for (NetSocket s : clients) netShutdown(s);
+    for (std::thread& t : workers)
+        if (t.joinable()) t.join();
+    for (NetSocket s : clients) netClose(s);
+    workers.clear();
+    clients.clear();
+}
+bool ModbusServer::isRunning() const
+{
+    return running;
+}
+int ModbusServer::getPort() const
+{
+    return port;
+}
+void ModbusServer::setLoopback(bool on)
+{
+    loopback = on;
+}
+void ModbusServer::setResponseDelay(int ms)
+{
+    delayMs = ms;
+}
+void ModbusServer::setCoil(int index, bool value)
+{
+    std::lock_guard<std::mutex> g(lock);
+    coils[index & 0xFFFF] = value;
+}
+bool ModbusServer::getCoil(int index)
+{
+    std::lock_guard<std::mutex> g(lock);
+    return coils[index & 0xFFFF] != 0;
+}
+void ModbusServer::setDiscreteInput(int index, bool value)
+{
+    std::lock_guard<std::mutex> g(lock);
+    discrete[index & 0xFFFF] = value;
+}
+void ModbusServer::setHoldingRegister(int index, uint16_t value)
+{
+    std::lock_guard<std::mutex> g(lock);
+    holding[index & 0xFFFF] = value;
+}
+uint16_t ModbusServer::getHoldingRegister(int index)
+{
+    std::lock_guard<std::mutex> g(lock);
+    return holding[index & 0xFFFF];
+}
+void ModbusServer::setInputRegister(int index, uint16_t value)
+{
+    std::lock_guard<std::mutex> g(lock);
+    input[index & 0xFFFF] = value;
+}
+long long ModbusServer::requestCount() const
+{
+    return requests;
+}
+void ModbusServer::acceptLoop()
+{
+    while (running) {
+        NetSocket s = netAccept(listener);
+        if (s == NET_INVALID) continue;
+        std::lock_guard<std::mutex> g(clientLock);
+        if (!running) {
+            netClose(s);
+            break;
+        }
+        clients.push_back(s);
+        workers.push_back(std::thread(&ModbusServer::serve, this, s));
+    }
+}
+void ModbusServer::serve(NetSocket s)
+{
+    uint8_t head[7], pdu[256], resp[7 + 256];
+    while (running) {
+        if (!netRecvAll(s, head, 7)) break;
+        int len = get16(head + 4) - 1;
+        if (len <= 0 || len > 253 || !netRecvAll(s, pdu, len)) break;
+
+        if (delayMs > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+
+        int n = handle(pdu, len, resp + 7);
+        requests++;
+        memcpy(resp, head, 4);                 // 事务号、协议号原样返回
+        put16(resp + 4, n + 1);
+        resp[6] = head[6];
+        if (!netSendAll(s, resp, 7 + n)) break;
+    }
+}
+int ModbusServer::handle(const uint8_t* pdu, int len, uint8_t* resp)
+{
+    uint8_t fc = pdu[0];
+    if (len < 5) return exception(fc, 3, resp);
+    int addr = get16(pdu + 1);
+    int qty = get16(pdu + 3);
+
+    std::lock_guard<std::mutex> g(lock);
+    // 回环：每次请求前同步一次
+    if (loopback) {
+        discrete = coils;
+        input = holding;
+    }
+
+    switch (fc) {
+    case 1:
+    case 2: {
+        // 读线圈 / 离散输入，按 LSB 在前打包
+        if (qty < 1 || qty > 2000 || addr + qty > tableSize) return exception(fc, 2, resp);
+        const std::vector<uint8_t>& table = fc == 1 ? coils : discrete;
+        int bytes = (qty + 7) / 8;
+        resp[0] = fc;
+        resp[1] = (uint8_t)bytes;
+        memset(resp + 2, 0, bytes);
+        for (int i = 0; i < qty; i++)
+            if (table[addr + i]) resp[2 + i / 8] |= 1 << (i % 8);
+        return 2 + bytes;
+    }
+    case 3:
+    case 4: {
+        if (qty < 1 || qty > 125 || addr + qty > tableSize) return exception(fc, 2, resp);
+        const std::vector<uint16_t>& table = fc == 3 ? holding : input;
+        resp[0] = fc;
+        resp[1] = (uint8_t)(qty * 2);
+        for (int i = 0; i < qty; i++)
+            put16(resp + 2 + i * 2, table[addr + i]);
+        return 2 + qty * 2;
+    }
+    case 5:
+        // qty 位置是写入值
+        if (qty != 0xFF00 && qty != 0x0000) return exception(fc, 3, resp);
+        coils[addr] = qty == 0xFF00;
+        memcpy(resp, pdu, 5);
+        return 5;
+    case 6:
+        holding[addr] = (uint16_t)qty;
+        memcpy(resp, pdu, 5);
+        return 5;
+    case 15: {
+        if (len < 6 || qty < 1 || qty > 1968 || addr + qty > tableSize || pdu[5] != (qty + 7) / 8
+            || len < 6 + pdu[5])
+            return exception(fc, 3, resp);
+        for (int i = 0; i < qty; i++)
+            coils[addr + i] = (pdu[6 + i / 8] >> (i % 8)) & 1;
+        memcpy(resp, pdu, 5);
+        return 5;
+    }
+    case 16: {
+        if (len < 6 || qty < 1 || qty > 123 || addr + qty > tableSize || pdu[5] != qty * 2
+            || len < 6 + pdu[5])
+            return exception(fc, 3, resp);
+        for (int i = 0; i < qty; i++)
+            holding[addr + i] = (uint16_t)get16(pdu + 6 + i * 2);
+        memcpy(resp, pdu, 5);
+        return 5;
+    }
+    case 22: {
+        // 掩码写：(当前值 AND andMask) OR (orMask AND NOT andMask)
+        if (len < 7) return exception(fc, 3, resp);
+        int andMask = qty;
+        int orMask = get16(pdu + 5);
+        holding[addr] = (uint16_t)((holding[addr] & andMask) | (orMask & ~andMask));
+        memcpy(resp, pdu, 7);
+        return 7;
+    }
+    default:
+        return exception(fc, 1, resp);
+    }
+}
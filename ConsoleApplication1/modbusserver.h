@@ -0,0 +1,58 @@
+﻿#pragma once
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include "netsock.h"
+
+// ModbusServer：本地 Modbus TCP 从站替身，用于在没有现场设备时调试 ModbusBackend
+// 支持功能码 1/2/3/4/5/6/15/16/22，每个连接一个线程，按收到的顺序应答（天然支持流水线请求）
+class ModbusServer
+{
+public:
+    ModbusServer();
+    ~ModbusServer();
+
+    // 在 127.0.0.1 上启动监听，port 为 0 时由系统分配
+    bool start(int port = 0);
+    void stop();
+    bool isRunning() const;
+    int getPort() const;
+
+    // 回环模式：离散输入跟随线圈，输入寄存器跟随保持寄存器
+    void setLoopback(bool on);
+    // 每个请求的应答延迟（毫秒）
+    void setResponseDelay(int ms);
+
+    // 直接访问数据表
+    void setCoil(int index, bool value);
+    bool getCoil(int index);
+    void setDiscreteInput(int index, bool value);
+    void setHoldingRegister(int index, uint16_t value);
+    uint16_t getHoldingRegister(int index);
+    void setInputRegister(int index, uint16_t value);
+    // 已处理的请求数
+    long long requestCount() const;
+private:
+    std::vector<uint8_t> coils;       // 65536 个线圈
+    std::vector<uint8_t> discrete;    // 65536 个离散输入
+    std::vector<uint16_t> holding;    // 65536 个保持寄存器
+    std::vector<uint16_t> input;      // 65536 个输入寄存器
+    std::mutex lock;                  // 保护数据表
+
+    NetSocket listener;
+    int port;
+    std::atomic<bool> running;
+    std::atomic<bool> loopback;
+    std::atomic<int> delayMs;
+    std::atomic<long long> requests;
+    std::thread acceptThread;
+    std::vector<std::thread> workers;
+    std::vector<NetSocket> clients;
+    std::mutex clientLock;            // 保护 workers / clients
+
+    void acceptLoop();
+    void serve(NetSocket s);
+    // 处理一个请求 PDU，应答写入 resp，返回应答长度
+    int handle(const uint8_t* pdu, int len, uint8_t* resp);
+};
@@ -0,0 +1,155 @@
+﻿#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#endif
+#include "netsock.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define NET_SOCK(s) ((SOCKET)(s))
+#else
+#define NET_SOCK(s) ((int)(s))
+#define closesocket close
+#endif
+
+bool netInit()
+{
+#ifdef _WIN32
+    static bool ok = false;
+    if (!ok) {
+        WSADATA wsa;
+        ok = WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+    }
+    return ok;
+#else
+    return true;
+#endif
+}
+static bool isValid(intptr_t s)
+{
+#ifdef _WIN32
+    return (SOCKET)s != INVALID_SOCKET;
+#else
+    return s >= 0;
+#endif
+}
+NetSocket netConnect(const std::string& host, int port, int timeoutMs)
+{
+    if (!netInit()) return NET_INVALID;
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0)
+        return NET_INVALID;
+
+    NetSocket s = NET_INVALID;
+    for (addrinfo* p = res; p; p = p->ai_next) {
+        intptr_t fd = (intptr_t)socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (!isValid(fd)) continue;
+        netSetTimeout(fd, timeoutMs);
+        if (connect(NET_SOCK(fd), p->ai_addr, (int)p->ai_addrlen) == 0) {
+            s = fd;
+            break;
+        }
+        closesocket(NET_SOCK(fd));
+    }
+    freeaddrinfo(res);
+    if (s != NET_INVALID) netNoDelay(s);
+    return s;
+}
+NetSocket netListen(const std::string& host, int& port)
+{
+    if (!netInit()) return NET_INVALID;
+    intptr_t fd = (intptr_t)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (!isValid(fd)) return NET_INVALID;
+
+    int yes = 1;
+    setsockopt(NET_SOCK(fd), SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    if (bind(NET_SOCK(fd), (sockaddr*)&addr, sizeof(addr)) != 0 || listen(NET_SOCK(fd), 16) != 0) {
+        closesocket(NET_SOCK(fd));
+        return NET_INVALID;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(NET_SOCK(fd), (sockaddr*)&addr, &len);
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+NetSocket netAccept(NetSocket listener)
+{
+    intptr_t fd = (intptr_t)accept(NET_SOCK(listener), nullptr, nullptr);
+    if (!isValid(fd)) return NET_INVALID;
+    netNoDelay(fd);
+    return fd;
+}
+bool netSendAll(NetSocket s, const void* data, size_t len)
+{
+    const char* p = (const char*)data;
+    while (len > 0) {
+        int n = send(NET_SOCK(s), p, (int)len, 0);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+bool netRecvAll(NetSocket s, void* buffer, size_t len)
+{
+    char* p = (char*)buffer;
+    while (len > 0) {
+        int n = recv(NET_SOCK(s), p, (int)len, 0);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+int netRecv(NetSocket s, void* buffer, size_t len)
+{
+    return recv(NET_SOCK(s), (char*)buffer, (int)len, 0);
+}
+void netSetTimeout(NetSocket s, int timeoutMs)
+{
+#ifdef _WIN32
+    DWORD tv = timeoutMs;
+#else
+    timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+#endif
+    setsockopt(NET_SOCK(s), SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+    setsockopt(NET_SOCK(s), SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv));
+}
+void netNoDelay(NetSocket s)
+{
+    int yes = 1;
+    setsockopt(NET_SOCK(s), IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+}
+void netShutdown(NetSocket s)
+{
+#ifdef _WIN32
+    shutdown(NET_SOCK(s), SD_BOTH);
+#else
+    shutdown(NET_SOCK(s), SHUT_RDWR);
+#endif
+}
+void netClose(NetSocket s)
+{
+    if (s != NET_INVALID)
+        closesocket(NET_SOCK(s));
+}
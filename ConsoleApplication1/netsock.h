@@ -0,0 +1,29 @@
+﻿#pragma once
+#include <string>
+#include <cstdint>
+
+// 简单的 TCP 套接字封装（Windows 使用 Winsock，其它平台使用 BSD socket）
+// 句柄统一用 intptr_t 表示，头文件中不引入 winsock2.h，避免与 windows.h 的包含顺序冲突
+typedef intptr_t NetSocket;
+const NetSocket NET_INVALID = -1;
+
+// 初始化网络库（可重复调用）
+bool netInit();
+// 连接 host:port，timeoutMs 同时作为收发超时，失败返回 NET_INVALID
+NetSocket netConnect(const std::string& host, int port, int timeoutMs);
+// 在本机地址上监听，port 为 0 时由系统分配，实际端口写回 port
+NetSocket netListen(const std::string& host, int& port);
+// 接受一个连接，失败返回 NET_INVALID
+NetSocket netAccept(NetSocket listener);
+// 完整发送 / 接收 len 字节
+bool netSendAll(NetSocket s, const void* data, size_t len);
+bool netRecvAll(NetSocket s, void* buffer, size_t len);
+// 接收任意长度数据，返回字节数，连接关闭或出错返回 <= 0
+int netRecv(NetSocket s, void* buffer, size_t len);
+// 设置收发超时（毫秒）
+void netSetTimeout(NetSocket s, int timeoutMs);
+// 禁用 Nagle 算法，降低小包延迟
+void netNoDelay(NetSocket s);
+// 关闭收发方向，唤醒阻塞在该套接字上的 recv / accept
+void netShutdown(NetSocket s);
+void netClose(NetSocket s);
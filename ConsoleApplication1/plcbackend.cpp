@@ -0,0 +1,183 @@
+﻿#include "plcbackend.h"
+
+int PLCBackend::writeBit(int area, int dbNumber, int start, int bit, bool value)
+{
+    uint8_t b = 0;
+    int result = readArea(area, dbNumber, start, 1, &b);
+    if (result != 0) return result;
+    if (value) b |= (1 << bit);
+    else b &= ~(1 << bit);
+    return writeArea(area, dbNumber, start, 1, &b);
+}
+int PLCBackend::readMulti(PLCDataItem* items, int count)
+{
+    int firstError = 0;
+    for (int i = 0; i < count; i++) {
+        PLCDataItem& it = items[i];
+        it.result = readArea(it.area, it.dbNumber, it.start, it.size, it.data);
+        if (it.result != 0 && firstError == 0) firstError = it.result;
+    }
+    return firstError;
+}
+int PLCBackend::writeMulti(PLCDataItem* items, int count)
+{
+    int firstError = 0;
+    for (int i = 0; i < count; i++) {
+        PLCDataItem& it = items[i];
+        it.result = it.bit >= 0
+            ? writeBit(it.area, it.dbNumber, it.start, it.bit, it.data[0] != 0)
+            : writeArea(it.area, it.dbNumber, it.start, it.size, it.data);
+        if (it.result != 0 && firstError == 0) firstError = it.result;
+    }
+    return firstError;
+}
+int PLCBackend::listBlocks(int, std::vector<int>& numbers)
+{
+    numbers.clear();
+    return plcErrNotSupported;
+}
+int PLCBackend::blockInfo(int, int, PLCBlockInfo&)
+{
+    return plcErrNotSupported;
+}
+int PLCBackend::uploadBlock(int, int, int, std::vector<uint8_t>& data)
+{
+    data.clear();
+    return plcErrNotSupported;
+}
+
+Snap7Backend::Snap7Backend()
+{
+    client = new TS7Client();  // 创建 Snap7 客户端
+    connected = false;
+}
+Snap7Backend::~Snap7Backend()
+{
+    disconnect();
+    delete client;
+}
+bool Snap7Backend::connect(const std::string& address, int rack, int slot)
+{
+    connected = client->ConnectTo(address.c_str(), rack, slot) == 0;
+    return connected;
+}
+void Snap7Backend::disconnect()
+{
+    if (connected) {
+        client->Disconnect();
+        connected = false;
+    }
+}
+bool Snap7Backend::isConnected() const
+{
+    return connected;
+}
+// DB 区与普通区统一走 ReadArea（DBRead 内部也是同样的请求）
+int Snap7Backend::readArea(int area, int dbNumber, int start, int size, uint8_t* buffer)
+{
+    if (!connected) return plcErrNotConnected;
+    return client->ReadArea(area, dbNumber, start, size, S7WLByte, buffer);
+}
+int Snap7Backend::writeArea(int area, int dbNumber, int start, int size, const uint8_t* buffer)
+{
+    if (!connected) return plcErrNotConnected;
+    // Snap7 的接口不带 const，但不会修改写入数据
+    return client->WriteArea(area, dbNumber, start, size, S7WLByte, const_cast<uint8_t*>(buffer));
+}
+int Snap7Backend::writeBit(int area, int dbNumber, int start, int bit, bool value)
+{
+    if (!connected) return plcErrNotConnected;
+    // S7WLBit 的起始地址以位计
+    uint8_t b = value ? 1 : 0;
+    return client->WriteArea(area, dbNumber, start * 8 + bit, 1, S7WLBit, &b);
+}
+int Snap7Backend::readMulti(PLCDataItem* items, int count)
+{
+    return multiVars(items, count, false);
+}
+int Snap7Backend::writeMulti(PLCDataItem* items, int count)
+{
+    return multiVars(items, count, true);
+}
+// 按 MaxVars 分组发送；整组失败（如超出 PDU）时退回逐项读写
+int Snap7Backend::multiVars(PLCDataItem* items, int count, bool write)
+{
+    if (!connected) return plcErrNotConnected;
+    int firstError = 0;
+    TS7DataItem vars[MaxVars];
+    uint8_t bits[MaxVars];
+    for (int base = 0; base < count; base += MaxVars) {
+        int n = count - base < MaxVars ? count - base : MaxVars;
+        for (int i = 0; i < n; i++) {
+            PLCDataItem& it = items[base + i];
+            TS7DataItem& v = vars[i];
+            v.Area = it.area;
+            v.DBNumber = it.dbNumber;
+            v.Result = 0;
+            if (write && it.bit >= 0) {
+                bits[i] = it.data[0] ? 1 : 0;
+                v.WordLen = S7WLBit;
+                v.Start = it.start * 8 + it.bit;
+                v.Amount = 1;
+                v.pdata = &bits[i];
+            }
+            else {
+                v.WordLen = S7WLByte;
+                v.Start = it.start;
+                v.Amount = it.size;
+                v.pdata = it.data;
+            }
+        }
+        int res = write ? client->WriteMultiVars(vars, n) : client->ReadMultiVars(vars, n);
+        for (int i = 0; i < n; i++) {
+            PLCDataItem& it = items[base + i];
+            if (res == 0)
+                it.result = vars[i].Result;
+            else if (write)
+                it.result = it.bit >= 0
+                    ? writeBit(it.area, it.dbNumber, it.start, it.bit, it.data[0] != 0)
+                    : writeArea(it.area, it.dbNumber, it.start, it.size, it.data);
+            else
+                it.result = readArea(it.area, it.dbNumber, it.start, it.size, it.data);
+            if (it.result != 0 && firstError == 0) firstError = it.result;
+        }
+    }
+    return firstError;
+}
+int Snap7Backend::listBlocks(int blockType, std::vector<int>& numbers)
+{
+    numbers.clear();
+    if (!connected) return plcErrNotConnected;
+    std::vector<word> list(sizeof(TS7BlocksOfType) / sizeof(word));
+    int count = (int)list.size();
+    int result = client->ListBlocksOfType(blockType, (TS7BlocksOfType*)list.data(), &count);
+    if (result != 0) return result;
+    numbers.assign(list.begin(), list.begin() + count);
+    return 0;
+}
+int Snap7Backend::blockInfo(int blockType, int number, PLCBlockInfo& info)
+{
+    if (!connected) return plcErrNotConnected;
+    TS7BlockInfo bi;
+    int result = client->GetAgBlockInfo(blockType, number, &bi);
+    if (result != 0) return result;
+    info.type = blockType;
+    info.number = number;
+    info.checksum = bi.CheckSum;
+    info.mc7Size = bi.MC7Size;
+    info.loadSize = bi.LoadSize;
+    info.codeDate = bi.CodeDate;
+    info.intfDate = bi.IntfDate;
+    return 0;
+}
+int Snap7Backend::uploadBlock(int blockType, int number, int loadSize, std::vector<uint8_t>& data)
+{
+    if (!connected) return plcErrNotConnected;
+    // 装载大小未知时按 64KB 上传，完成后截断到实际大小
+    int capacity = loadSize > 0 ? loadSize + 256 : 65536;
+    data.resize(capacity);
+    int size = capacity;
+    int result = client->FullUpload(blockType, number, data.data(), &size);
+    data.resize(result == 0 ? size : 0);
+    return result;
+}
@@ -0,0 +1,113 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "snap7.h"
+
+// 后端通用错误码（Snap7 自身的错误码原样返回，这里只补充后端自己的错误）
+enum PLCError
+{
+    plcOK = 0,
+    plcErrNotConnected = 0x7F000001,  // 未连接
+    plcErrOutOfRange,                 // 地址越界
+    plcErrInjected,                   // 仿真注入的错误
+    plcErrNotSupported,               // 后端不支持该操作
+    plcErrIO,                         // 网络收发失败
+    plcErrProtocol,                   // 应答格式错误
+    plcErrDevice,                     // 设备返回异常码
+};
+
+// Modbus 区域代码（与 Snap7 区域代码不重叠）
+// 按字节映像寻址：寄存器 n 对应字节 2n、2n+1（大端），线圈 n 对应字节 n/8 的第 n%8 位
+const int MBAreaCoils = 0x01;          // 线圈（读写）
+const int MBAreaDiscreteInputs = 0x02; // 离散输入（只读）
+const int MBAreaHoldingRegs = 0x03;    // 保持寄存器（读写）
+const int MBAreaInputRegs = 0x04;      // 输入寄存器（只读）
+
+// 批量读写项
+struct PLCDataItem
+{
+    int area;        // 区域代码
+    int dbNumber;    // DB 块号（非 DB 为 0）
+    int start;       // 起始字节
+    int size;        // 字节数
+    int bit;         // 位写入时的位号，字节读写为 -1
+    uint8_t* data;   // 调用者提供的缓冲区
+    int result;      // 单项结果，0 为成功
+};
+
+// 程序块信息（对应 Snap7 的 TS7BlockInfo 中用于判断变更的字段）
+struct PLCBlockInfo
+{
+    int type;              // 块类型：Block_OB / Block_FB / Block_FC / Block_DB ...
+    int number;            // 块号
+    int checksum;          // 块校验和
+    int mc7Size;           // MC7 代码大小
+    int loadSize;          // 装载大小
+    std::string codeDate;  // 代码时间戳
+    std::string intfDate;  // 接口时间戳
+};
+
+// PLCBackend：PLC 通讯后端接口，PLCClient 只通过它访问 PLC
+// area 使用 Snap7 区域代码（S7AreaPE / S7AreaPA / S7AreaMK / S7AreaDB）或上面的 Modbus 区域代码
+// 所有读写以字节为单位，返回 0 表示成功
+class PLCBackend
+{
+public:
+    virtual ~PLCBackend() {}
+
+    // 连接 / 断开
+    virtual bool connect(const std::string& address, int rack, int slot) = 0;
+    virtual void disconnect() = 0;
+    virtual bool isConnected() const = 0;
+
+    // 读写一段连续字节
+    virtual int readArea(int area, int dbNumber, int start, int size, uint8_t* buffer) = 0;
+    virtual int writeArea(int area, int dbNumber, int start, int size, const uint8_t* buffer) = 0;
+
+    // 写单个位，默认读出整个字节修改后写回
+    virtual int writeBit(int area, int dbNumber, int start, int bit, bool value);
+
+    // 批量读写，结果写入每一项的 result，返回 0 表示全部成功
+    // 默认逐项调用上面的接口，后端可以合并成更少的请求
+    virtual int readMulti(PLCDataItem* items, int count);
+    virtual int writeMulti(PLCDataItem* items, int count);
+
+    // 程序块访问，默认不支持
+    // 列出某类型的全部块号
+    virtual int listBlocks(int blockType, std::vector<int>& numbers);
+    // 读取块信息（不上传块内容）
+    virtual int blockInfo(int blockType, int number, PLCBlockInfo& info);
+    // 完整上传一个块；loadSize 为已知的装载大小（来自 blockInfo），0 表示未知
+    virtual int uploadBlock(int blockType, int number, int loadSize, std::vector<uint8_t>& data);
+};
+
+// Snap7Backend：基于 TS7Client 的西门子 S7 后端
+class Snap7Backend : public PLCBackend
+{
+public:
+    Snap7Backend();
+    ~Snap7Backend();
+
+    bool connect(const std::string& address, int rack, int slot) override;
+    void disconnect() override;
+    bool isConnected() const override;
+
+    int readArea(int area, int dbNumber, int start, int size, uint8_t* buffer) override;
+    int writeArea(int area, int dbNumber, int start, int size, const uint8_t* buffer) override;
+    int writeBit(int area, int dbNumber, int start, int bit, bool value) override;
+
+    // 使用 ReadMultiVars / WriteMultiVars，每次最多 MaxVars 项
+    int readMulti(PLCDataItem* items, int count) override;
+    int writeMulti(PLCDataItem* items, int count) override;
+
+    // ListBlocksOfType / GetAgBlockInfo / FullUpload
+    int listBlocks(int blockType, std::vector<int>& numbers) override;
+    int blockInfo(int blockType, int number, PLCBlockInfo& info) override;
+    int uploadBlock(int blockType, int number, int loadSize, std::vector<uint8_t>& data) override;
+private:
+    TS7Client* client;  // Snap7 客户端对象
+    bool connected;     // 当前是否连接
+
+    int multiVars(PLCDataItem* items, int count, bool write);
+};
@@ -1,38 +1,52 @@
 #include "plcclient.h"
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 using namespace std;
 PLCClient::PLCClient()
 {
-    client = new TS7Client();  //  Snap7 ͻ
-    connected = false;         // Ĭδ
+    backend = new Snap7Backend();  // Ĭʹ Snap7 
 }
 PLCClient::~PLCClient()
 {
     disconnectPLC();           // ӣȶϿ
-    delete client;             // ͷ Snap7 ͻ˶
+    delete backend;            // ͷź˶
+}
+//
+void PLCClient::setBackend(PLCBackend* newBackend)
+{
+    if (newBackend == backend) return;
+    disconnectPLC();
+    delete backend;
+    backend = newBackend;
+}
+PLCBackend* PLCClient::getBackend() const
+{
+    return backend;
 }
 //plc
 bool PLCClient::connectPLC(const  string& plc_ip, int rack, int slot)
 {
-    int result = client->ConnectTo(plc_ip.c_str(), rack, slot);
-    if (result == 0) {       
-        connected = true;
-        return true;
-    }
-    connected = false;
-    return false;
+    return backend->connect(plc_ip, rack, slot);
 }
 //Ͽ
 void PLCClient::disconnectPLC()
 {
-    if (connected) {
-        client->Disconnect(); 
-        connected = false;
-    }
+    if (backend->isConnected())
+        backend->disconnect();
 }
 //ѯǷ
 bool PLCClient::isConnected() const
 {
-    return connected;
+    return backend->isConnected();
 }
 int areaCode(char c)
 {
@@ -53,11 +67,11 @@ bool PLCClient::parseAddress(const  string& addr,int& area, int& dbNumber, int&
     dbNumber = 0;
     bitIndex = -1;
     // λַ 
-     regex bitPattern(R"(([IQM])(\d+)\.(\d+))");
+    static const regex bitPattern(R"(([IQM])(\d+)\.(\d+))");
     // ֽ//˫
-     regex bytePattern(R"(([IQM])([BWD])(\d+))");
+    static const regex bytePattern(R"(([IQM])([BWD])(\d+))");
     // DB
-     regex dbPattern(R"(DB(\d+)\.DB([XWD])(\d+)(?:\.(\d+))?)");
+    static const regex dbPattern(R"(DB(\d+)\.DB([XWD])(\d+)(?:\.(\d+))?)");
      smatch m;
     // ַ I/Q/M ӳΪ Snap7 
     //һ֣λַ I0.0
@@ -97,58 +111,59 @@ bool PLCClient::parseAddress(const  string& addr,int& area, int& dbNumber, int&
         else return false;
         return true;
     }
+    // Modbus Ȧ / ɢ룺C12DI3λţ
+    static const regex mbBitPattern(R"((C|DI)(\d+))");
+    if (regex_match(addr, m, mbBitPattern)) {
+        area = m[1].str() == "C" ? MBAreaCoils : MBAreaDiscreteInputs;
+        int n = stoi(m[2].str());
+        start = n / 8;
+        bitIndex = n % 8;
+        dataSize = 1;
+        return true;
+    }
+    // Modbus ĴHR10HR10.3HD10IR4IR4.0IRD4Ĵţ
+    // Ĵ˫ IRDID  S7 ˫֣Ѿƥ
+    static const regex mbRegPattern(R"((HR|HD|IR|IRD)(\d+)(?:\.(\d+))?)");
+    if (regex_match(addr, m, mbRegPattern)) {
+        string kind = m[1].str();
+        area = kind[0] == 'H' ? MBAreaHoldingRegs : MBAreaInputRegs;
+        int n = stoi(m[2].str());
+        start = n * 2;
+        dataSize = kind == "HR" || kind == "IR" ? 2 : 4;
+        if (m[3].matched) {
+            // Ĵڵλ 8 λǰһֽ
+            int bit = stoi(m[3].str());
+            if (dataSize != 2 || bit > 15) return false;
+            start += bit < 8 ? 1 : 0;
+            bitIndex = bit % 8;
+            dataSize = 1;
+        }
+        return true;
+    }
     return false;  // ʧ
 }
-//
-bool PLCClient::readAddress(const  string& addr, int32_t& value)
+// ݴСѻתΪֵˣ
+static int32_t decodeValue(const uint8_t* buffer, int bitIndex, int dataSize)
 {
-    if (!connected) return false;
-    int area, dbNumber, start, bitIndex, dataSize;
-    if (!parseAddress(addr, area, dbNumber, start, bitIndex, dataSize))
-        return false;
-    uint8_t buffer[4] = { 0 };   // 4ֽ
-    // DBȡ or ͨȡ
-    int result = (area == S7AreaDB)
-        ? client->DBRead(dbNumber, start, dataSize, buffer)
-        : client->ReadArea(area, 0, start, dataSize, S7WLByte, buffer);
-    if (result != 0)
-        return false;
     //  λ
-    if (bitIndex >= 0) {
-        value = (buffer[0] >> bitIndex) & 1;
-        return true;
-    }
+    if (bitIndex >= 0)
+        return (buffer[0] >> bitIndex) & 1;
     //  ֽڷB  
-    if (dataSize == 1) {
-        value = buffer[0];
-    }
+    if (dataSize == 1)
+        return buffer[0];
     //  ַW
-    else if (dataSize == 2) {
-        value = (buffer[0] << 8) | buffer[1];  // 
-    }
+    if (dataSize == 2)
+        return (buffer[0] << 8) | buffer[1];  // 
     //  ˫ַD 
-    else if (dataSize == 4) {
-        value = (buffer[0] << 24) | (buffer[1] << 16)
-            | (buffer[2] << 8) | buffer[3];
-    }
-    return true;
+    return (buffer[0] << 24) | (buffer[1] << 16)
+        | (buffer[2] << 8) | buffer[3];
 }
-//д
-bool PLCClient::writeAddress(const  string& addr, int32_t value)
+static void encodeValue(int32_t value, int bitIndex, int dataSize, uint8_t* buffer)
 {
-    if (!connected) return false;
-    int area, dbNumber, start, bitIndex, dataSize;
-    if (!parseAddress(addr, area, dbNumber, start, bitIndex, dataSize))
-        return false;
-    uint8_t buffer[4] = { 0 };
     if (bitIndex >= 0) {
-        buffer[0] = (value ? (1 << bitIndex) : 0);
-
-        return (area == S7AreaDB)
-            ? client->DBWrite(dbNumber, start, 1, buffer) == 0
-            : client->WriteArea(area, 0, start, 1, S7WLByte, buffer) == 0;
+        buffer[0] = value ? 1 : 0;
+        return;
     }
-
     // ---------- ֽ ----------
     if (dataSize == 1) {
         buffer[0] = (uint8_t)value;
@@ -165,10 +180,255 @@ bool PLCClient::writeAddress(const  string& addr, int32_t value)
         buffer[2] = (value >> 8) & 0xFF;
         buffer[3] = value & 0xFF;
     }
+}
+//ԭʼֽڶ
+bool PLCClient::read(int area, int dbNumber, int start, span<std::byte> dst)
+{
+    if (!isConnected()) return false;
+    return backend->readArea(area, dbNumber, start, (int)dst.size(),
+        reinterpret_cast<uint8_t*>(dst.data())) == 0;
+}
+//ԭʼֽд
+bool PLCClient::write(int area, int dbNumber, int start, span<const std::byte> src)
+{
+    if (!isConnected()) return false;
+    return backend->writeArea(area, dbNumber, start, (int)src.size(),
+        reinterpret_cast<const uint8_t*>(src.data())) == 0;
+}
+//ԭʼдitems 仺ɵ߳
+bool PLCClient::read(span<PLCDataItem> items)
+{
+    if (!isConnected() || items.empty()) return false;
+    return backend->readMulti(items.data(), (int)items.size()) == 0;
+}
+bool PLCClient::write(span<PLCDataItem> items)
+{
+    if (!isConnected() || items.empty()) return false;
+    return backend->writeMulti(items.data(), (int)items.size()) == 0;
+}
+//
+bool PLCClient::readAddress(const  string& addr, int32_t& value)
+{
+    int area, dbNumber, start, bitIndex, dataSize;
+    if (!parseAddress(addr, area, dbNumber, start, bitIndex, dataSize))
+        return false;
+    std::byte buffer[4] = {};   // 4ֽ
+    if (!read(area, dbNumber, start, span<std::byte>(buffer, dataSize)))
+        return false;
+    value = decodeValue(reinterpret_cast<uint8_t*>(buffer), bitIndex, dataSize);
+    return true;
+}
+//д
+bool PLCClient::writeAddress(const  string& addr, int32_t value)
+{
+    if (!isConnected()) return false;
+    int area, dbNumber, start, bitIndex, dataSize;
+    if (!parseAddress(addr, area, dbNumber, start, bitIndex, dataSize))
+        return false;
+    // λд뽻˰λ
+    if (bitIndex >= 0)
+        return backend->writeBit(area, dbNumber, start, bitIndex, value != 0) == 0;
+
+    uint8_t buffer[4] = { 0 };
+    encodeValue(value, bitIndex, dataSize, buffer);
+    return write(area, dbNumber, start, as_bytes(span<uint8_t>(buffer, dataSize)));
+}
+//
+bool PLCClient::readAddresses(const vector<string>& addrs, vector<int32_t>& values, vector<bool>* itemOk)
+{
+    size_t n = addrs.size();
+    values.assign(n, 0);
+    if (itemOk) itemOk->assign(n, false);
+    if (!isConnected()) return false;
+
+    vector<uint8_t> buffer(n * 4, 0);
+    vector<PLCDataItem> items;
+    vector<int> bits;
+    vector<size_t> index;     // items Ӧĵַ±
+    for (size_t i = 0; i < n; i++) {
+        int area, dbNumber, start, bitIndex, dataSize;
+        if (!parseAddress(addrs[i], area, dbNumber, start, bitIndex, dataSize))
+            continue;
+        PLCDataItem it = { area, dbNumber, start, dataSize, -1, &buffer[i * 4], 0 };
+        items.push_back(it);
+        bits.push_back(bitIndex);
+        index.push_back(i);
+    }
+    if (!items.empty())
+        read(items);
+
+    bool all = items.size() == n;
+    for (size_t k = 0; k < items.size(); k++) {
+        if (items[k].result != 0) {
+            all = false;
+            continue;
+        }
+        values[index[k]] = decodeValue(items[k].data, bits[k], items[k].size);
+        if (itemOk) (*itemOk)[index[k]] = true;
+    }
+    return all;
+}
+//д
+bool PLCClient::writeAddresses(const vector<string>& addrs, const vector<int32_t>& values, vector<bool>* itemOk)
+{
+    size_t n = addrs.size() < values.size() ? addrs.size() : values.size();
+    if (itemOk) itemOk->assign(addrs.size(), false);
+    if (!isConnected()) return false;
+
+    vector<uint8_t> buffer(n * 4, 0);
+    vector<PLCDataItem> items;
+    vector<size_t> index;
+    for (size_t i = 0; i < n; i++) {
+        int area, dbNumber, start, bitIndex, dataSize;
+        if (!parseAddress(addrs[i], area, dbNumber, start, bitIndex, dataSize))
+            continue;
+        encodeValue(values[i], bitIndex, dataSize, &buffer[i * 4]);
+        PLCDataItem it = { area, dbNumber, start, dataSize, bitIndex, &buffer[i * 4], 0 };
+        items.push_back(it);
+        index.push_back(i);
+    }
+    if (!items.empty())
+        write(items);
 
-    int result = (area == S7AreaDB)
-        ? client->DBWrite(dbNumber, start, dataSize, buffer)
-        : client->WriteArea(area, 0, start, dataSize, S7WLByte, buffer);
+    bool all = items.size() == addrs.size();
+    for (size_t k = 0; k < items.size(); k++) {
+        if (items[k].result != 0) {
+            all = false;
+            continue;
+        }
+        if (itemOk) (*itemOk)[index[k]] = true;
+    }
+    return all;
+}
+// ػеһ¼
+struct CachedBlock
+{
+    PLCBlockInfo info;
+    uint64_t hash;     // ϴݵ FNV-1a ϣ
+};
+static uint64_t fnv1a(const vector<uint8_t>& data)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (uint8_t b : data) {
+        h ^= b;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+static string blockName(int type, int number)
+{
+    const char* name = type == Block_OB ? "OB" : type == Block_FB ? "FB"
+        : type == Block_FC ? "FC" : type == Block_DB ? "DB" : "BLK";
+    return name + to_string(number);
+}
+// Ϣһֶα仯Ϊ޸
+static bool sameInfo(const PLCBlockInfo& a, const PLCBlockInfo& b)
+{
+    return a.checksum == b.checksum && a.mc7Size == b.mc7Size && a.loadSize == b.loadSize
+        && a.codeDate == b.codeDate && a.intfDate == b.intfDate;
+}
+//ͬ龵
+bool PLCClient::syncBlocks(const string& dir, BlockSyncResult& result)
+{
+    result = BlockSyncResult();
+    if (!isConnected()) return false;
+    auto t0 = chrono::steady_clock::now();
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
 
-    return result == 0;
+    // ȡ棺  У MC7С װشС ʱ ӿʱ ϣ
+    string indexPath = dir + "/blocks.idx";
+    map<pair<int, int>, CachedBlock> cache;
+    {
+        ifstream in(indexPath);
+        string line;
+        while (getline(in, line)) {
+            istringstream ss(line);
+            CachedBlock c;
+            ss >> c.info.type >> c.info.number >> c.info.checksum >> c.info.mc7Size
+                >> c.info.loadSize >> c.info.codeDate >> c.info.intfDate >> hex >> c.hash;
+            if (!ss) continue;
+            if (c.info.codeDate == "-") c.info.codeDate.clear();
+            if (c.info.intfDate == "-") c.info.intfDate.clear();
+            cache[make_pair(c.info.type, c.info.number)] = c;
+        }
+    }
+
+    const int types[] = { Block_OB, Block_FB, Block_FC, Block_DB };
+    map<pair<int, int>, CachedBlock> current;
+    bool listedAny = false;
+    vector<int> listedTypes;    // ɹгֻͣЩ͵Ŀ PLC ϶ɾ
+    vector<int> numbers;
+    vector<uint8_t> data;
+    for (int type : types) {
+        if (backend->listBlocks(type, numbers) != 0)
+            continue;
+        listedAny = true;
+        listedTypes.push_back(type);
+        for (int number : numbers) {
+            result.listed++;
+            pair<int, int> key(type, number);
+            string file = dir + "/" + blockName(type, number) + ".mc7";
+
+            CachedBlock c;
+            if (backend->blockInfo(type, number, c.info) != 0) {
+                // Ϣȡʧʱɼ¼´
+                result.failed++;
+                if (cache.count(key)) current[key] = cache[key];
+                continue;
+            }
+            // ԪδҾļڣϴ
+            auto old = cache.find(key);
+            if (old != cache.end() && sameInfo(old->second.info, c.info) && ifstream(file).good()) {
+                current[key] = old->second;
+                result.unchanged++;
+                continue;
+            }
+
+            if (backend->uploadBlock(type, number, c.info.loadSize, data) != 0) {
+                // ϴʧʱͬɼ¼뾵ļ´
+                result.failed++;
+                if (old != cache.end()) current[key] = old->second;
+                continue;
+            }
+            c.hash = fnv1a(data);
+            ofstream(file, ios::binary).write((const char*)data.data(), data.size());
+            current[key] = c;
+            result.uploaded++;
+            if (old == cache.end() || old->second.hash != c.hash)
+                result.changed.push_back(blockName(type, number));
+        }
+    }
+    if (!listedAny) return false;
+
+    // PLC ѲڵĿ飺ɾļбȡʧܵͲжϣԭ¼
+    for (auto& kv : cache) {
+        if (current.count(kv.first)) continue;
+        if (find(listedTypes.begin(), listedTypes.end(), kv.first.first) == listedTypes.end()) {
+            current[kv.first] = kv.second;
+            continue;
+        }
+        remove((dir + "/" + blockName(kv.first.first, kv.first.second) + ".mc7").c_str());
+        result.removed++;
+        result.changed.push_back(blockName(kv.first.first, kv.first.second));
+    }
+
+    // дػ棨дʱļ滻;ʧ°
+    {
+        ofstream out(indexPath + ".tmp");
+        for (auto& kv : current) {
+            const PLCBlockInfo& i = kv.second.info;
+            out << i.type << ' ' << i.number << ' ' << i.checksum << ' ' << i.mc7Size << ' '
+                << i.loadSize << ' ' << (i.codeDate.empty() ? "-" : i.codeDate) << ' '
+                << (i.intfDate.empty() ? "-" : i.intfDate) << ' ' << hex << kv.second.hash << dec << '\n';
+        }
+    }
+    remove(indexPath.c_str());
+    rename((indexPath + ".tmp").c_str(), indexPath.c_str());
+
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    return true;
 }
@@ -1,15 +1,37 @@
 #pragma once
 #include <string>
 #include "snap7.h"
+#include "plcbackend.h"
 #include <regex>
 #include <iostream>
-// PLCClientװ Snap7 ͻˣ PLCַд
+#include <vector>
+#include <span>
+#include <cstddef>
+// 龵һͬ
+struct BlockSyncResult
+{
+    int listed = 0;                    // PLC ϵĿ
+    int uploaded = 0;                  // Ԫݱ仯ϴĿ
+    int unchanged = 0;                 // Ԫδ䡢ֱʹûĿ
+    int removed = 0;                   // PLC ɾĿ
+    int failed = 0;                    // ȡϢϴʧܵĿ
+    std::vector<std::string> changed;  // ݷ仯Ŀ飨 "FB1"
+    double seconds = 0;                // ܺʱ
+};
+
+// PLCClientַַͨͨѶ˶д PLC
+// ĬϺΪ Snap7Ҳɻɷ PLC ʵ
 class PLCClient
 {
 public:
     PLCClient();
     ~PLCClient();
 
+    // ͨѶˣȶϿǰӣPLCClient ӹ newBackend ͷ
+    void setBackend(PLCBackend* newBackend);
+    // ǰʹõĺ
+    PLCBackend* getBackend() const;
+
     // ӵ PLC
     // plc_ip: PLC  IP ַ
     // rack: ܺţһ 0
@@ -20,22 +42,45 @@ public:
     void disconnectPLC();
     // صǰ״̬
     bool isConnected() const;
+    // ԭʼֽڶдֱӶдṩĻм仺塢ڴ
+    // area: S7AreaPE / S7AreaPA / S7AreaMK / S7AreaDB  MBArea*ֽ span ĳ
+    bool read(int area, int dbNumber, int start, std::span<std::byte> dst);
+    bool write(int area, int dbNumber, int start, std::span<const std::byte> src);
+    // ԭʼдÿһ data ָ߳еĻдÿһ result
+    // ѭظʹͬһ items 
+    bool read(std::span<PLCDataItem> items);
+    bool write(std::span<PLCDataItem> items);
+
     // Զַַȡֵ
     // addr:  "I0.0""Q0.0""M10.2""MW20""DB1.DBW2"
+    //       Modbus ˣ"C12"Ȧ"DI3"ɢ룩"HR10" / "HR10.3" / "HD10"ּĴ /λ/˫֣
+    //       "IR4" / "IR4.0" / "IRD4"Ĵ /λ/˫֣"ID4"  S7 ˫֣
     // value: 
     bool readAddress(const std::string& addr, int32_t& value);
-    // Զַַдֵ
+    // ԶַַдֵλַֻĸλӰֽͬڵλ
     bool writeAddress(const std::string& addr, int32_t value);
-private:
-    TS7Client* client;  // Snap7 ͻ˶
-    bool connected;     // ǰǷ
+
+    // ȡԭʼȡ֮ϣһνˣɺ˺ϲɾٵ
+    // values  addrs һһӦitemOk ǿʱÿһǷɹȫɹ true
+    bool readAddresses(const std::vector<std::string>& addrs, std::vector<int32_t>& values,
+        std::vector<bool>* itemOk = nullptr);
+    // д
+    bool writeAddresses(const std::vector<std::string>& addrs, const std::vector<int32_t>& values,
+        std::vector<bool>* itemOk = nullptr);
+
+    // ͬ龵 dir Ŀ¼OB / FB / FC / DB
+    // ÿϢУ͡Сʱ뱾ػ blocks.idx Ƚϣֻϴб仯Ŀ
+    // ˲ֿ֧ʻδʱ false
+    bool syncBlocks(const std::string& dir, BlockSyncResult& result);
 
     // ַַΪ PLC Ϣ
     // ؽǷɹ
     bool parseAddress(const std::string& addr,
-        int& area,       // ڴI/Q/M/DB
+        int& area,       // ڴI/Q/M/DB  Modbus ű
         int& dbNumber,   // DBţDBΪ0
         int& start,      // ʼֽ
         int& bitIndex,   // λֽ/ֵΪ -1
         int& dataSize);  // ݴС1ֽ / 2ֽ / 4ֽڣ
+private:
+    PLCBackend* backend;  // ͨѶ
 };
\ No newline at end of file
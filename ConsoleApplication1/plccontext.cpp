@@ -0,0 +1,91 @@
+﻿#include "plccontext.h"
+#include "plcclient.h"
+#include <chrono>
+#include <fstream>
+
+void PLCContext::addWatch(const std::string& name, const std::string& address)
+{
+    watch.push_back({ name.empty() ? address : name, address });
+    addresses.push_back(address);
+    stats.watched = (int)watch.size();
+}
+
+void PLCContext::clear()
+{
+    watch.clear();
+    addresses.clear();
+    stats.watched = 0;
+}
+
+int PLCContext::load(const std::string& file)
+{
+    std::ifstream in(file);
+    if (!in) return -1;
+    clear();
+    std::string line;
+    bool first = true;
+    while (std::getline(in, line)) {
+        if (first && line.rfind("\xEF\xBB\xBF", 0) == 0) line = line.substr(3);
+        first = false;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t eq = line.find('=');
+        if (line.empty() || line[0] == '#' || eq == std::string::npos) continue;
+        std::string name = line.substr(0, eq), address = line.substr(eq + 1);
+        while (!name.empty() && name.back() == ' ') name.pop_back();
+        while (!address.empty() && address[0] == ' ') address.erase(0, 1);
+        while (!address.empty() && address.back() == ' ') address.pop_back();
+        if (!address.empty())
+            addWatch(name, address);
+    }
+    return (int)watch.size();
+}
+
+void PLCContext::reset()
+{
+    for (auto& it : watch) it.known = false;
+}
+
+std::string PLCContext::snapshot(PLCClient& plc, bool full)
+{
+    stats.sent = stats.failed = 0;
+    stats.bytes = 0;
+    if (watch.empty()) return "";
+    // 还没有发送过任何值时也是完整快照
+    if (!full) {
+        full = true;
+        for (auto& it : watch)
+            if (it.known) { full = false; break; }
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<int32_t> values;
+    std::vector<bool> ok;
+    plc.readAddresses(addresses, values, &ok);
+    stats.readMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    std::string lines;
+    for (size_t i = 0; i < watch.size(); i++) {
+        Item& it = watch[i];
+        if (!ok[i]) {
+            stats.failed++;
+            continue;
+        }
+        if (!full && it.known && it.last == values[i]) continue;
+        it.last = values[i];
+        it.known = true;
+        lines += it.name;
+        lines += '=';
+        lines += std::to_string(values[i]);
+        lines += '\n';
+        stats.sent++;
+    }
+    if (lines.empty()) return "";
+
+    // 完整快照与增量用不同的标题，模型据此判断没列出的值是否仍然有效
+    std::string out = full ? u8"[PLC 当前值]\n" : u8"[PLC 变化]\n";
+    out += lines;
+    stats.bytes = out.size();
+    stats.snapshots++;
+    stats.totalBytes += (long long)out.size();
+    return out;
+}
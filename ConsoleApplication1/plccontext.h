@@ -0,0 +1,48 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class PLCClient;
+
+// 上一次快照的统计
+struct PLCContextStats
+{
+    int watched = 0;        // 关注的地址数
+    int sent = 0;           // 本次发送的行数
+    int failed = 0;         // 读取失败的地址数
+    size_t bytes = 0;       // 本次附加的字节数
+    double readMs = 0;      // 批量读取耗时
+    long long snapshots = 0;
+    long long totalBytes = 0;
+};
+
+// PLCContext：把关注的 PLC 地址的当前值附加到 AI 请求中
+// 每轮一次批量读取，按 "名称=值" 每行一项紧凑输出；只发送与上一轮相比变化的值，
+// 历史被清空、淘汰或摘要后（模型可能已看不到之前的值）再发送一次完整快照
+class PLCContext
+{
+public:
+    void addWatch(const std::string& name, const std::string& address);
+    void clear();
+    // 从文件加载，每行 "名称=地址"，UTF-8 编码，# 开头为注释；返回加载的条数，文件打不开返回 -1
+    int load(const std::string& file);
+    int size() const { return (int)watch.size(); }
+
+    // 读取并生成要附加的文本：full 为 true 或首次调用时输出全部值，否则只输出变化的值；没有可发送的内容时返回空串
+    std::string snapshot(PLCClient& plc, bool full);
+    // 下一次快照输出全部值
+    void reset();
+
+    const PLCContextStats& getStats() const { return stats; }
+private:
+    struct Item {
+        std::string name;
+        std::string address;
+        int32_t last = 0;
+        bool known = false;     // last 是否已发送过
+    };
+    std::vector<Item> watch;
+    std::vector<std::string> addresses;   // 与 watch 对应，批量读取时复用
+    PLCContextStats stats;
+};
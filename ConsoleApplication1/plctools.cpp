@@ -0,0 +1,130 @@
+﻿#include "plctools.h"
+#include <json/json.h>
+#include <chrono>
+
+static std::string toJson(const Json::Value& v)
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    builder["emitUTF8"] = true;
+    return Json::writeString(builder, v);
+}
+static std::string errorResult(const std::string& message)
+{
+    Json::Value r;
+    r["error"] = message;
+    return toJson(r);
+}
+
+const std::string& PLCTools::definitions()
+{
+    static const std::string tools =
+        u8"[{\"type\":\"function\",\"function\":{\"name\":\"read_tags\","
+        u8"\"description\":\"批量读取 PLC 地址的当前值，一次调用列出所有需要的地址\","
+        u8"\"parameters\":{\"type\":\"object\",\"properties\":{\"addresses\":{\"type\":\"array\","
+        u8"\"items\":{\"type\":\"string\"},\"description\":\"地址，如 I0.0、Q0.1、MW100、DB1.DBW4、HR10\"}},"
+        u8"\"required\":[\"addresses\"]}}},"
+        u8"{\"type\":\"function\",\"function\":{\"name\":\"write_tags\","
+        u8"\"description\":\"批量写入 PLC 地址，位地址写 0 或 1\","
+        u8"\"parameters\":{\"type\":\"object\",\"properties\":{\"writes\":{\"type\":\"array\","
+        u8"\"items\":{\"type\":\"object\",\"properties\":{\"address\":{\"type\":\"string\"},"
+        u8"\"value\":{\"type\":\"integer\"}},\"required\":[\"address\",\"value\"]}}},"
+        u8"\"required\":[\"writes\"]}}}]";
+    return tools;
+}
+
+PLCToolStats PLCTools::execute(PLCClient& plc, std::vector<AIToolCall>& calls)
+{
+    PLCToolStats stats;
+
+    // 1) 解析参数，收集所有调用的地址；owner 记录每个地址属于哪个调用
+    std::vector<Json::Value> results(calls.size());
+    std::vector<std::string> writeAddrs, readAddrs;
+    std::vector<int32_t> writeValues;
+    std::vector<size_t> writeOwner, readOwner;
+
+    Json::CharReaderBuilder reader;
+    std::unique_ptr<Json::CharReader> r(reader.newCharReader());
+    for (size_t i = 0; i < calls.size(); i++) {
+        AIToolCall& c = calls[i];
+        Json::Value args;
+        std::string errors;
+        const std::string& a = c.arguments;
+        if (!r->parse(a.data(), a.data() + a.size(), &args, &errors) || !args.isObject()) {
+            c.result = errorResult("invalid arguments");
+            continue;
+        }
+        // 参数由模型生成，类型不对的项（地址不是字符串、值不是 32 位整数）原样列入 failed，不交给 PLC
+        Json::Value& failed = results[i]["failed"] = Json::Value(Json::arrayValue);
+        if (c.name == "read_tags") {
+            const Json::Value& list = args["addresses"];
+            for (Json::ArrayIndex k = 0; list.isArray() && k < list.size(); k++) {
+                if (!list[k].isString()) {
+                    failed.append(list[k]);
+                    stats.failed++;
+                    continue;
+                }
+                readAddrs.push_back(list[k].asString());
+                readOwner.push_back(i);
+            }
+            results[i]["values"] = Json::Value(Json::objectValue);
+        }
+        else if (c.name == "write_tags") {
+            const Json::Value& list = args["writes"];
+            for (Json::ArrayIndex k = 0; list.isArray() && k < list.size(); k++) {
+                const Json::Value& w = list[k];
+                if (!w.isObject() || !w["address"].isString() || !w["value"].isInt()) {
+                    failed.append(w);
+                    stats.failed++;
+                    continue;
+                }
+                writeAddrs.push_back(w["address"].asString());
+                writeValues.push_back(w["value"].asInt());
+                writeOwner.push_back(i);
+            }
+            results[i]["written"] = Json::Value(Json::arrayValue);
+        }
+        else {
+            c.result = errorResult("unknown function: " + c.name);
+            continue;
+        }
+    }
+
+    // 2) 一次批量写入、一次批量读取
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<bool> writeOk, readOk;
+    std::vector<int32_t> readValues;
+    if (!writeAddrs.empty())
+        plc.writeAddresses(writeAddrs, writeValues, &writeOk);
+    if (!readAddrs.empty())
+        plc.readAddresses(readAddrs, readValues, &readOk);
+    stats.plcMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    // 3) 结果分回各个调用
+    for (size_t k = 0; k < writeAddrs.size(); k++) {
+        Json::Value& res = results[writeOwner[k]];
+        if (k < writeOk.size() && writeOk[k]) {
+            res["written"].append(writeAddrs[k]);
+            stats.writes++;
+        }
+        else {
+            res["failed"].append(writeAddrs[k]);
+            stats.failed++;
+        }
+    }
+    for (size_t k = 0; k < readAddrs.size(); k++) {
+        Json::Value& res = results[readOwner[k]];
+        if (k < readOk.size() && readOk[k]) {
+            res["values"][readAddrs[k]] = readValues[k];
+            stats.reads++;
+        }
+        else {
+            res["failed"].append(readAddrs[k]);
+            stats.failed++;
+        }
+    }
+    for (size_t i = 0; i < calls.size(); i++)
+        if (calls[i].result.empty())
+            calls[i].result = toJson(results[i]);
+    return stats;
+}
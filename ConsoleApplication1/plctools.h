@@ -0,0 +1,43 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include "deepseek.h"
+#include "plcclient.h"
+
+// 一轮工具调用的执行统计
+struct PLCToolStats
+{
+    int reads = 0;        // 读取的地址数
+    int writes = 0;       // 写入的地址数
+    int failed = 0;       // 失败的地址数
+    double plcMs = 0;     // PLC 通信耗时（毫秒）
+};
+
+// 多步函数调用的预算：一轮用户输入中任一项用完时不再执行函数调用，要求模型用已有结果作答
+struct AgentBudget
+{
+    int maxSteps = 4;               // 执行函数调用的步数
+    int maxMs = 30000;              // 整轮耗时（毫秒）
+    long long maxTokens = 32000;    // 整轮消耗的 token（输入 + 输出）
+};
+
+// 一步的统计：一次模型请求 + 该请求的函数调用合并后的一次批量读写
+struct AgentStep
+{
+    int calls = 0;          // 模型请求的函数调用数
+    PLCToolStats plc;       // 批量读写统计（未执行时为 0）
+    double modelMs = 0;     // 模型请求耗时
+    long long tokens = 0;   // 本次请求的输入 + 输出 token
+};
+
+// PLCTools：AI 函数调用（tools）与 PLC 读写之间的桥梁
+// 提供 read_tags / write_tags 两个函数定义，参数都是地址数组，
+// 同一轮的所有调用合并成一次批量写入和一次批量读取（先写后读，读到的是写入后的值）
+class PLCTools
+{
+public:
+    // OpenAI 兼容的 tools 定义（JSON 数组文本），内容固定，可直接放进请求前缀
+    static const std::string& definitions();
+    // 执行一轮工具调用，把结果 JSON 写入每个调用的 result
+    static PLCToolStats execute(PLCClient& plc, std::vector<AIToolCall>& calls);
+};
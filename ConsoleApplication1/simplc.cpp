@@ -0,0 +1,238 @@
+﻿#include "simplc.h"
+#include <chrono>
+#include <cstring>
+
+SimulatedPLC::SimulatedPLC() : SimulatedPLC(SimConfig())
+{
+}
+SimulatedPLC::SimulatedPLC(const SimConfig& cfg)
+    : config(cfg), running(false), connected(false), ops(0), rng(std::random_device()())
+{
+    mem.inputs.assign(config.inputSize, 0);
+    mem.outputs.assign(config.outputSize, 0);
+    mem.markers.assign(config.markerSize, 0);
+}
+SimulatedPLC::~SimulatedPLC()
+{
+    disconnect();
+}
+// 仿真 CPU 不需要地址，连接即开始扫描
+bool SimulatedPLC::connect(const std::string&, int, int)
+{
+    stopScan();
+    connected = true;
+    if (logic) {
+        running = true;
+        scanThread = std::thread(&SimulatedPLC::scanLoop, this);
+    }
+    return true;
+}
+void SimulatedPLC::disconnect()
+{
+    stopScan();
+    connected = false;
+}
+bool SimulatedPLC::isConnected() const
+{
+    return connected;
+}
+void SimulatedPLC::setLogic(Logic fn)
+{
+    stopScan();
+    logic = fn;
+    if (connected && logic) {
+        running = true;
+        scanThread = std::thread(&SimulatedPLC::scanLoop, this);
+    }
+}
+void SimulatedPLC::setLatency(int latencyUs, int jitterUs)
+{
+    std::lock_guard<std::mutex> g(lock);
+    config.latencyUs = latencyUs;
+    config.jitterUs = jitterUs;
+}
+void SimulatedPLC::setErrorInjection(double errorRate, int failEvery)
+{
+    std::lock_guard<std::mutex> g(lock);
+    config.errorRate = errorRate;
+    config.failEvery = failEvery;
+}
+long long SimulatedPLC::operationCount() const
+{
+    return ops;
+}
+uint8_t* SimulatedPLC::locate(int area, int dbNumber, int start, int size)
+{
+    std::vector<uint8_t>* region = nullptr;
+    if (area == S7AreaPE)
+        region = &mem.inputs;
+    else if (area == S7AreaPA)
+        region = &mem.outputs;
+    else if (area == S7AreaMK)
+        region = &mem.markers;
+    else if (area == S7AreaDB) {
+        if (dbNumber <= 0) return nullptr;
+        std::vector<uint8_t>& db = mem.dbs[dbNumber];
+        if (db.empty()) db.assign(config.dbSize, 0);  // 首次访问自动创建
+        region = &db;
+    }
+    if (!region || start < 0 || size < 0 || start + size > (int)region->size())
+        return nullptr;
+    return region->data() + start;
+}
+int SimulatedPLC::simulate(int& delayUs)
+{
+    long long n = ++ops;
+    delayUs = config.latencyUs;
+    if (config.jitterUs > 0)
+        delayUs += std::uniform_int_distribution<int>(0, config.jitterUs)(rng);
+
+    if (config.failEvery > 0 && n % config.failEvery == 0)
+        return plcErrInjected;
+    if (config.errorRate > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < config.errorRate)
+        return plcErrInjected;
+    return 0;
+}
+template <typename Fn>
+int SimulatedPLC::request(Fn fn)
+{
+    if (!connected) return plcErrNotConnected;
+    int delayUs = 0, err;
+    {
+        std::lock_guard<std::mutex> g(lock);
+        err = simulate(delayUs);
+    }
+    if (delayUs > 0)
+        std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+    if (err) return err;
+
+    std::lock_guard<std::mutex> g(lock);
+    return fn();
+}
+int SimulatedPLC::readArea(int area, int dbNumber, int start, int size, uint8_t* buffer)
+{
+    return request([&]() {
+        uint8_t* p = locate(area, dbNumber, start, size);
+        if (!p) return (int)plcErrOutOfRange;
+        memcpy(buffer, p, size);
+        return 0;
+    });
+}
+int SimulatedPLC::writeArea(int area, int dbNumber, int start, int size, const uint8_t* buffer)
+{
+    return request([&]() {
+        uint8_t* p = locate(area, dbNumber, start, size);
+        if (!p) return (int)plcErrOutOfRange;
+        memcpy(p, buffer, size);
+        return 0;
+    });
+}
+int SimulatedPLC::writeBit(int area, int dbNumber, int start, int bit, bool value)
+{
+    return request([&]() {
+        uint8_t* p = locate(area, dbNumber, start, 1);
+        if (!p || bit < 0 || bit > 7) return (int)plcErrOutOfRange;
+        if (value) *p |= (1 << bit);
+        else *p &= ~(1 << bit);
+        return 0;
+    });
+}
+int SimulatedPLC::readMulti(PLCDataItem* items, int count)
+{
+    int result = request([&]() {
+        int firstError = 0;
+        for (int i = 0; i < count; i++) {
+            PLCDataItem& it = items[i];
+            uint8_t* p = locate(it.area, it.dbNumber, it.start, it.size);
+            it.result = p ? 0 : plcErrOutOfRange;
+            if (p) memcpy(it.data, p, it.size);
+            else if (firstError == 0) firstError = it.result;
+        }
+        return firstError;
+    });
+    // 整个请求失败时每一项都记为同样的错误
+    if (result == plcErrNotConnected || result == plcErrInjected)
+        for (int i = 0; i < count; i++) items[i].result = result;
+    return result;
+}
+int SimulatedPLC::writeMulti(PLCDataItem* items, int count)
+{
+    int result = request([&]() {
+        int firstError = 0;
+        for (int i = 0; i < count; i++) {
+            PLCDataItem& it = items[i];
+            uint8_t* p = locate(it.area, it.dbNumber, it.start, it.bit >= 0 ? 1 : it.size);
+            it.result = p ? 0 : plcErrOutOfRange;
+            if (!p) {
+                if (firstError == 0) firstError = it.result;
+            }
+            else if (it.bit >= 0) {
+                if (it.data[0]) *p |= (1 << it.bit);
+                else *p &= ~(1 << it.bit);
+            }
+            else
+                memcpy(p, it.data, it.size);
+        }
+        return firstError;
+    });
+    // 整个请求失败时每一项都记为同样的错误
+    if (result == plcErrNotConnected || result == plcErrInjected)
+        for (int i = 0; i < count; i++) items[i].result = result;
+    return result;
+}
+int SimulatedPLC::listBlocks(int blockType, std::vector<int>& numbers)
+{
+    numbers.clear();
+    return request([&]() {
+        if (blockType == Block_DB)
+            for (auto& db : mem.dbs)
+                numbers.push_back(db.first);
+        return 0;
+    });
+}
+int SimulatedPLC::blockInfo(int blockType, int number, PLCBlockInfo& info)
+{
+    return request([&]() {
+        auto it = mem.dbs.find(number);
+        if (blockType != Block_DB || it == mem.dbs.end()) return (int)plcErrOutOfRange;
+        uint16_t sum = 0;
+        for (uint8_t b : it->second)
+            sum = (uint16_t)((sum << 1 | sum >> 15) ^ b);
+        info.type = blockType;
+        info.number = number;
+        info.checksum = sum;
+        info.mc7Size = (int)it->second.size();
+        info.loadSize = (int)it->second.size();
+        info.codeDate = "2020/01/01";
+        info.intfDate = "2020/01/01";
+        return 0;
+    });
+}
+int SimulatedPLC::uploadBlock(int blockType, int number, int, std::vector<uint8_t>& data)
+{
+    data.clear();
+    return request([&]() {
+        auto it = mem.dbs.find(number);
+        if (blockType != Block_DB || it == mem.dbs.end()) return (int)plcErrOutOfRange;
+        data = it->second;
+        return 0;
+    });
+}
+// 扫描线程：按周期在锁内执行一次逻辑
+void SimulatedPLC::scanLoop()
+{
+    while (running) {
+        auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(config.cycleMs);
+        {
+            std::lock_guard<std::mutex> g(lock);
+            if (logic) logic(mem);
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+void SimulatedPLC::stopScan()
+{
+    running = false;
+    if (scanThread.joinable())
+        scanThread.join();
+}
@@ -0,0 +1,88 @@
+﻿#pragma once
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <functional>
+#include "plcbackend.h"
+
+// 仿真 PLC 的存储区：I / Q / M 与按块号区分的 DB
+struct SimMemory
+{
+    std::vector<uint8_t> inputs;              // I 区
+    std::vector<uint8_t> outputs;             // Q 区
+    std::vector<uint8_t> markers;             // M 区
+    std::map<int, std::vector<uint8_t>> dbs;  // DB 区（块号 → 数据）
+};
+
+// 仿真参数
+struct SimConfig
+{
+    int inputSize = 1024;      // I 区字节数
+    int outputSize = 1024;     // Q 区字节数
+    int markerSize = 8192;     // M 区字节数
+    int dbSize = 4096;         // DB 首次访问时自动创建的大小
+    int latencyUs = 0;         // 每次读写的模拟延迟（微秒）
+    int jitterUs = 0;          // 延迟的随机抖动（微秒）
+    double errorRate = 0.0;    // 随机注入错误的概率（0 ~ 1）
+    int failEvery = 0;         // 每 N 次读写注入一次错误（0 表示关闭）
+    int cycleMs = 10;          // 脚本逻辑的扫描周期（毫秒）
+};
+
+// SimulatedPLC：进程内的仿真 CPU，不需要网络即可驱动 PLCClient
+// 可选的脚本逻辑在独立线程中按扫描周期运行，与读写共用同一把锁
+class SimulatedPLC : public PLCBackend
+{
+public:
+    typedef std::function<void(SimMemory&)> Logic;
+
+    SimulatedPLC();
+    explicit SimulatedPLC(const SimConfig& cfg);
+    ~SimulatedPLC();
+
+    bool connect(const std::string& address, int rack, int slot) override;
+    void disconnect() override;
+    bool isConnected() const override;
+
+    int readArea(int area, int dbNumber, int start, int size, uint8_t* buffer) override;
+    int writeArea(int area, int dbNumber, int start, int size, const uint8_t* buffer) override;
+    int writeBit(int area, int dbNumber, int start, int bit, bool value) override;
+
+    // 批量读写视为一次请求，只计一次延迟
+    int readMulti(PLCDataItem* items, int count) override;
+    int writeMulti(PLCDataItem* items, int count) override;
+
+    // 程序块：仿真 CPU 只有已创建的 DB，校验和由 DB 内容计算
+    int listBlocks(int blockType, std::vector<int>& numbers) override;
+    int blockInfo(int blockType, int number, PLCBlockInfo& info) override;
+    int uploadBlock(int blockType, int number, int loadSize, std::vector<uint8_t>& data) override;
+
+    // 设置扫描逻辑（连接后开始运行），传空函数表示不运行
+    void setLogic(Logic fn);
+    // 运行时调整延迟与错误注入
+    void setLatency(int latencyUs, int jitterUs);
+    void setErrorInjection(double errorRate, int failEvery);
+    // 累计读写次数
+    long long operationCount() const;
+private:
+    SimConfig config;
+    SimMemory mem;
+    Logic logic;
+    mutable std::mutex lock;      // 保护 mem / config / rng
+    std::thread scanThread;
+    std::atomic<bool> running;
+    std::atomic<bool> connected;
+    std::atomic<long long> ops;
+    std::mt19937 rng;
+
+    // 返回区域内 [start, start+size) 的指针，越界返回 nullptr（需持锁）
+    uint8_t* locate(int area, int dbNumber, int start, int size);
+    // 计算本次操作的延迟与需要注入的错误码（需持锁，延迟在锁外等待）
+    int simulate(int& delayUs);
+    // 执行一次模拟请求：延迟与错误注入后在锁内调用 fn
+    template <typename Fn> int request(Fn fn);
+    void scanLoop();
+    void stopScan();
+};